@@ -40,9 +40,13 @@ struct CameraConfig
     struct Resolution {
         unsigned width;
         unsigned height;
+
+        bool operator == (const Resolution&) const = default;
     };
     std::optional<Resolution> resolution;
     std::optional<unsigned> framerate;
+
+    bool operator == (const CameraConfig&) const = default;
 };
 
 struct RecordConfig
@@ -61,6 +65,8 @@ struct RecordConfig
     const std::filesystem::path dir;
     const uint64_t maxDirSize;
     const uint64_t maxFileSize;
+
+    bool operator == (const RecordConfig&) const = default;
 };
 
 struct StreamerConfig
@@ -99,6 +105,13 @@ struct StreamerConfig
     std::optional<std::string> edidFilePath;
     std::optional<CameraConfig> cameraConfig;
     bool useHwEncoder = true;
+    std::chrono::milliseconds filesListUpdateDelay = std::chrono::seconds(1);
+    // FilePlayer viewers starting within it share playback started by the first one,
+    // so they join mid-stream; zero gives every viewer own playback from file start
+    std::chrono::seconds filePlayerJoinWindow {};
+    std::optional<unsigned> maxViewers;
+
+    bool operator == (const StreamerConfig&) const = default;
 };
 
 #if !defined(BUILD_AS_CAMERA_STREAMER) && !defined(BUILD_AS_V4L2_RESTREAMER)
@@ -122,12 +135,22 @@ struct Config : public signalling::Config
     spdlog::level::level_enum logLevel = spdlog::level::info;
     spdlog::level::level_enum lwsLogLevel = spdlog::level::warn;
 
+    bool mainLoopProfiler = false;
+    std::chrono::milliseconds slowDispatchThreshold = std::chrono::milliseconds(50);
+
     std::optional<SignallingServer> signallingServer;
     bool forceServerMode = false;
 
     std::map<std::string, StreamerConfig> streamers; // escaped streamer name -> StreamerConfig
     bool authRequired = true;
 
+    // mount points are created on first request and destroyed after idle timeout
+    bool lazyMounts = false;
+    std::chrono::seconds lazyMountsIdleTimeout = std::chrono::seconds(60);
+
+    // viewers of all streamers together
+    std::optional<unsigned> maxViewers;
+
     std::shared_ptr<WebRTCConfig> webRTCConfig = std::make_shared<WebRTCConfig>();
 
     std::optional<std::string> publicIp;
@@ -138,6 +161,8 @@ struct Config : public signalling::Config
 
     CoturnConfig coturnConfig;
 
+    std::optional<unsigned short> metricsPort;
+
     bool useAgentMode() const { return signallingServer.has_value(); }
     bool useServerMode() const { return !signallingServer.has_value() || forceServerMode; }
 };
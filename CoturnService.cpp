@@ -0,0 +1,273 @@
+#include "CoturnService.h"
+
+#include "Log.h"
+
+
+namespace {
+
+const auto Log = ReStreamerLog;
+
+enum {
+    MAX_STOP_ATTEMPTS = 4,
+};
+
+}
+
+struct CoturnService::CommandData {
+    CoturnService* service;
+    CommandFinished finished;
+};
+
+CoturnService::CoturnService(const std::string& snapName, const std::string& snapCommon) noexcept :
+    _snapName(snapName),
+    _snapCommon(snapCommon),
+    _cancellablePtr(g_cancellable_new())
+{
+}
+
+CoturnService::~CoturnService()
+{
+    // spawned commands will finish on their own, but won't touch service
+    g_cancellable_cancel(_cancellablePtr.get());
+
+    if(_retrySourcePtr)
+        g_source_destroy(_retrySourcePtr.get());
+}
+
+void CoturnService::run(const std::string& commandLine, const CommandFinished& finished) noexcept
+{
+    g_autoptr(GError) error = nullptr;
+
+    g_auto(GStrv) argv = nullptr;
+    if(!g_shell_parse_argv(commandLine.c_str(), nullptr, &argv, &error)) {
+        finished(error, nullptr);
+        return;
+    }
+
+    g_autoptr(GSubprocess) subprocess =
+        g_subprocess_newv(argv, G_SUBPROCESS_FLAGS_STDOUT_PIPE, &error);
+    if(!subprocess) {
+        finished(error, nullptr);
+        return;
+    }
+
+    g_subprocess_communicate_utf8_async(
+        subprocess,
+        nullptr,
+        _cancellablePtr.get(),
+        onCommandFinished,
+        new CommandData { this, finished });
+}
+
+void CoturnService::onCommandFinished(GObject* source, GAsyncResult* result, gpointer userData)
+{
+    std::unique_ptr<CommandData> commandDataPtr(static_cast<CommandData*>(userData));
+
+    GSubprocess* subprocess = G_SUBPROCESS(source);
+
+    g_autoptr(GError) error = nullptr;
+    g_autofree gchar* output = nullptr;
+    const bool communicated =
+        g_subprocess_communicate_utf8_finish(subprocess, result, &output, nullptr, &error);
+    if(!communicated && g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        return; // service is destroyed already
+
+    if(communicated)
+        g_spawn_check_wait_status(g_subprocess_get_status(subprocess), &error);
+
+    commandDataPtr->finished(error, output);
+}
+
+// to workaround "error running snapctl: snap "rtsp-to-webrtsp" has "install-snap" change in progress"
+// have to try multiple times
+void CoturnService::stop(bool disable, unsigned attempt, const std::function<void ()>& stopped) noexcept
+{
+    const std::string command =
+        "snapctl stop " + _snapName + ".Coturn" + (disable ? " --disable" : "");
+
+    run(command, [this, disable, attempt, stopped] (const GError* error, const gchar*) {
+        if(!error) {
+            Log()->info(disable ? "Coturn disabled" : "Coturn stopped");
+            if(stopped)
+                stopped();
+            return;
+        }
+
+        Log()->error(
+            fmt::runtime(disable ? "Failed to disable Coturn: {}" : "Failed to stop Coturn: {}"),
+            error->message);
+
+        if(attempt + 1 >= MAX_STOP_ATTEMPTS) {
+            if(stopped)
+                stopped();
+            return;
+        }
+
+        const unsigned delay = attempt + 1;
+        Log()->info("Will try to stop Coturn another time in {} seconds...", delay);
+
+        struct CallbackData {
+            CoturnService* service;
+            bool disable;
+            unsigned attempt;
+            std::function<void ()> stopped;
+        };
+
+        _retrySourcePtr.reset(g_timeout_source_new_seconds(delay));
+        GSource* timeoutSource = _retrySourcePtr.get();
+        g_source_set_callback(
+            timeoutSource,
+            [] (gpointer userData) -> gboolean {
+                const CallbackData* callbackData = reinterpret_cast<CallbackData*>(userData);
+                CoturnService* service = callbackData->service;
+                service->_retrySourcePtr.reset();
+                service->stop(callbackData->disable, callbackData->attempt + 1, callbackData->stopped);
+                return false;
+            },
+            new CallbackData { this, disable, attempt, stopped },
+            [] (gpointer userData) {
+                delete reinterpret_cast<CallbackData*>(userData);
+            });
+        GMainContext* threadContext = g_main_context_get_thread_default();
+        g_source_attach(timeoutSource, threadContext ? threadContext : g_main_context_default());
+    });
+}
+
+void CoturnService::disable() noexcept
+{
+    stop(true, 0, nullptr);
+}
+
+void CoturnService::start(const Started& started) noexcept
+{
+    _started = started;
+    _startRequestedAt = std::chrono::steady_clock::now();
+
+    stop(false, 0, std::bind(&CoturnService::setInitialPublicIP, this));
+}
+
+void CoturnService::setInitialPublicIP() noexcept
+{
+    const std::optional<std::string> publicIp = _publicIp;
+    const std::string command =
+        publicIp ?
+            "snapctl set public-ip=" + *publicIp :
+            "snapctl unset public-ip";
+
+    run(command, [this, publicIp] (const GError* error, const gchar*) {
+        if(error) {
+            Log()->error("Failed to set \"public-ip\": {}", error->message);
+            return;
+        }
+
+        _appliedPublicIp = publicIp;
+
+        generateSecret();
+    });
+}
+
+void CoturnService::generateSecret() noexcept
+{
+    run("pwgen --secure --capitalize 127", [this] (const GError* error, const gchar* output) {
+        if(error || !output) {
+            Log()->error("Failed to generate TURN REST API secret: {}", error ? error->message : "no output");
+            return;
+        }
+
+        std::string staticAuthSecret = output;
+        if(!staticAuthSecret.empty() && staticAuthSecret.back() == '\n')
+            staticAuthSecret.pop_back();
+
+        deleteSecrets(staticAuthSecret);
+    });
+}
+
+void CoturnService::deleteSecrets(const std::string& staticAuthSecret) noexcept
+{
+    const std::string command =
+        "turnadmin --db=" + _snapCommon + "/turndb --delete-all-secret --realm=" + _snapName;
+
+    run(command, [this, staticAuthSecret] (const GError* error, const gchar*) {
+        if(error) {
+            Log()->error("Failed to delete old TURN REST API secrets: {}", error->message);
+            return;
+        }
+
+        setSecret(staticAuthSecret);
+    });
+}
+
+void CoturnService::setSecret(const std::string& staticAuthSecret) noexcept
+{
+    const std::string command =
+        "turnadmin --db=" + _snapCommon + "/turndb --set-secret=" + staticAuthSecret + " --realm=" + _snapName;
+
+    run(command, [this, staticAuthSecret] (const GError* error, const gchar*) {
+        if(error) {
+            Log()->error("Failed to set TURN REST API secret: {}", error->message);
+            return;
+        }
+
+        startService(staticAuthSecret);
+    });
+}
+
+void CoturnService::startService(const std::string& staticAuthSecret) noexcept
+{
+    run("snapctl start " + _snapName + ".Coturn", [this, staticAuthSecret] (const GError* error, const gchar*) {
+        if(error) {
+            Log()->error("Failed to enable Coturn: {}", error->message);
+            return;
+        }
+
+        _running = true;
+
+        Log()->info("Coturn configured and started");
+        LogStartupPhase("Coturn provisioning", _startRequestedAt);
+
+        if(_started)
+            _started(staticAuthSecret);
+
+        // public IP could be detected while Coturn was starting
+        applyPublicIP();
+    });
+}
+
+void CoturnService::setPublicIP(const std::string& publicIp) noexcept
+{
+    _publicIp = publicIp;
+
+    applyPublicIP();
+}
+
+void CoturnService::applyPublicIP() noexcept
+{
+    if(!_running || _updatingPublicIP || !_publicIp || _publicIp == _appliedPublicIp)
+        return;
+
+    _updatingPublicIP = true;
+
+    const std::string publicIp = *_publicIp;
+    run("snapctl set public-ip=" + publicIp, [this, publicIp] (const GError* error, const gchar*) {
+        if(error) {
+            Log()->error("Failed to set \"public-ip\": {}", error->message);
+            _updatingPublicIP = false;
+            return;
+        }
+
+        run("snapctl restart " + _snapName + ".Coturn", [this, publicIp] (const GError* error, const gchar*) {
+            _updatingPublicIP = false;
+
+            if(error) {
+                Log()->error("Failed to restart Coturn: {}", error->message);
+                return;
+            }
+
+            _appliedPublicIp = publicIp;
+            Log()->info("Coturn restarted with public IP {}", publicIp);
+
+            // public IP could change again while Coturn was restarting
+            applyPublicIP();
+        });
+    });
+}
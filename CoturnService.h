@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <gio/gio.h>
+
+#include <CxxPtr/GlibPtr.h>
+
+
+// manages Coturn service of snap package,
+// every step is done asynchronously on thread default main context
+class CoturnService
+{
+public:
+    typedef std::function<void (const std::string& staticAuthSecret)> Started;
+
+    CoturnService(const std::string& snapName, const std::string& snapCommon) noexcept;
+    ~CoturnService();
+
+    void disable() noexcept;
+    // stops running instance, generates new TURN REST API secret and starts Coturn
+    void start(const Started&) noexcept;
+
+    // Coturn is restarted to pick up new IP if it's running already
+    void setPublicIP(const std::string&) noexcept;
+
+private:
+    // error is nullptr on success
+    typedef std::function<void (const GError* error, const gchar* output)> CommandFinished;
+    struct CommandData;
+
+    void run(const std::string& commandLine, const CommandFinished&) noexcept;
+    static void onCommandFinished(GObject*, GAsyncResult*, gpointer userData);
+
+    void stop(bool disable, unsigned attempt, const std::function<void ()>& stopped) noexcept;
+    void setInitialPublicIP() noexcept;
+    void generateSecret() noexcept;
+    void deleteSecrets(const std::string& staticAuthSecret) noexcept;
+    void setSecret(const std::string& staticAuthSecret) noexcept;
+    void startService(const std::string& staticAuthSecret) noexcept;
+    void applyPublicIP() noexcept;
+
+private:
+    struct ObjectUnref {
+        void operator() (gpointer object) { g_object_unref(object); }
+    };
+
+    const std::string _snapName;
+    const std::string _snapCommon;
+
+    std::unique_ptr<GCancellable, ObjectUnref> _cancellablePtr;
+    GSourcePtr _retrySourcePtr;
+
+    Started _started;
+    std::chrono::steady_clock::time_point _startRequestedAt;
+    bool _running = false;
+    bool _updatingPublicIP = false;
+
+    std::optional<std::string> _publicIp; // last detected one
+    std::optional<std::string> _appliedPublicIp; // the one Coturn was started with
+};
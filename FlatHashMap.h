@@ -0,0 +1,202 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+
+// open addressing hash map with linear probing, keeps entries in single array,
+// so doesn't allocate per entry. Any insert or erase invalidates iterators.
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class FlatHashMap
+{
+public:
+    typedef std::pair<Key, Value> value_type;
+
+    class iterator
+    {
+    public:
+        value_type& operator * () const { return **_slot; }
+        value_type* operator -> () const { return &**_slot; }
+
+        iterator& operator ++ ()
+        {
+            ++_slot;
+            skipEmpty();
+            return *this;
+        }
+
+        bool operator == (const iterator&) const = default;
+
+    private:
+        friend class FlatHashMap;
+
+        iterator(std::optional<value_type>* slot, std::optional<value_type>* end) :
+            _slot(slot), _end(end) { skipEmpty(); }
+
+        void skipEmpty() { while(_slot != _end && !*_slot) ++_slot; }
+
+        std::optional<value_type>* _slot;
+        std::optional<value_type>* _end;
+    };
+
+    bool empty() const { return _size == 0; }
+    size_t size() const { return _size; }
+
+    iterator begin() { return iterator(_slots.data(), _slots.data() + _slots.size()); }
+    iterator end() { return iterator(_slots.data() + _slots.size(), _slots.data() + _slots.size()); }
+
+    void reserve(size_t count);
+    void clear();
+
+    iterator find(const Key&);
+    const Value* lookup(const Key&) const; // nullptr if key is absent
+    size_t count(const Key& key) { return find(key) != end() ? 1 : 0; }
+
+    std::pair<iterator, bool> emplace(Key, Value);
+
+    void erase(iterator);
+    size_t erase(const Key&);
+
+private:
+    size_t slotIndex(const Key&) const;
+    size_t nextIndex(size_t index) const { return (index + 1) & (_slots.size() - 1); }
+    iterator iteratorAt(size_t index);
+    void rehash(size_t slotsCount);
+
+private:
+    std::vector<std::optional<value_type>> _slots; // size is power of 2 or 0
+    size_t _size = 0;
+};
+
+template<typename Key, typename Value, typename Hash>
+size_t FlatHashMap<Key, Value, Hash>::slotIndex(const Key& key) const
+{
+    // Fibonacci hashing spreads sequential keys like CSeq
+    const uint64_t hash = static_cast<uint64_t>(Hash()(key)) * 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>(hash >> 32) & (_slots.size() - 1);
+}
+
+template<typename Key, typename Value, typename Hash>
+typename FlatHashMap<Key, Value, Hash>::iterator FlatHashMap<Key, Value, Hash>::iteratorAt(size_t index)
+{
+    return iterator(_slots.data() + index, _slots.data() + _slots.size());
+}
+
+template<typename Key, typename Value, typename Hash>
+void FlatHashMap<Key, Value, Hash>::rehash(size_t slotsCount)
+{
+    std::vector<std::optional<value_type>> slots(slotsCount);
+    slots.swap(_slots);
+    _size = 0;
+
+    for(std::optional<value_type>& slot: slots) {
+        if(slot)
+            emplace(std::move(slot->first), std::move(slot->second));
+    }
+}
+
+template<typename Key, typename Value, typename Hash>
+void FlatHashMap<Key, Value, Hash>::reserve(size_t count)
+{
+    // load factor is kept below 3/4
+    size_t slotsCount = _slots.empty() ? 8 : _slots.size();
+    while(count * 4 >= slotsCount * 3)
+        slotsCount *= 2;
+
+    if(slotsCount != _slots.size())
+        rehash(slotsCount);
+}
+
+template<typename Key, typename Value, typename Hash>
+void FlatHashMap<Key, Value, Hash>::clear()
+{
+    for(std::optional<value_type>& slot: _slots)
+        slot.reset();
+    _size = 0;
+}
+
+template<typename Key, typename Value, typename Hash>
+typename FlatHashMap<Key, Value, Hash>::iterator FlatHashMap<Key, Value, Hash>::find(const Key& key)
+{
+    if(_slots.empty())
+        return end();
+
+    for(size_t index = slotIndex(key); _slots[index]; index = nextIndex(index)) {
+        if(_slots[index]->first == key)
+            return iteratorAt(index);
+    }
+
+    return end();
+}
+
+template<typename Key, typename Value, typename Hash>
+const Value* FlatHashMap<Key, Value, Hash>::lookup(const Key& key) const
+{
+    if(_slots.empty())
+        return nullptr;
+
+    for(size_t index = slotIndex(key); _slots[index]; index = nextIndex(index)) {
+        if(_slots[index]->first == key)
+            return &_slots[index]->second;
+    }
+
+    return nullptr;
+}
+
+template<typename Key, typename Value, typename Hash>
+std::pair<typename FlatHashMap<Key, Value, Hash>::iterator, bool>
+FlatHashMap<Key, Value, Hash>::emplace(Key key, Value value)
+{
+    reserve(_size + 1);
+
+    size_t index = slotIndex(key);
+    for(; _slots[index]; index = nextIndex(index)) {
+        if(_slots[index]->first == key)
+            return { iteratorAt(index), false };
+    }
+
+    _slots[index].emplace(std::move(key), std::move(value));
+    ++_size;
+
+    return { iteratorAt(index), true };
+}
+
+template<typename Key, typename Value, typename Hash>
+void FlatHashMap<Key, Value, Hash>::erase(iterator it)
+{
+    assert(it != end());
+
+    size_t index = it._slot - _slots.data();
+    _slots[index].reset();
+    --_size;
+
+    // backward shift deletion: move up entries which probe sequence passes through freed slot
+    for(size_t next = nextIndex(index); _slots[next]; next = nextIndex(next)) {
+        const size_t home = slotIndex(_slots[next]->first);
+        const bool reachable =
+            index <= next ?
+                (home <= index || home > next) :
+                (home <= index && home > next);
+        if(reachable) {
+            _slots[index] = std::move(_slots[next]);
+            _slots[next].reset();
+            index = next;
+        }
+    }
+}
+
+template<typename Key, typename Value, typename Hash>
+size_t FlatHashMap<Key, Value, Hash>::erase(const Key& key)
+{
+    iterator it = find(key);
+    if(it == end())
+        return 0;
+
+    erase(it);
+
+    return 1;
+}
@@ -0,0 +1,207 @@
+#include "ListCache.h"
+
+#include <algorithm>
+
+#include <glib.h>
+
+#include <CxxPtr/GlibPtr.h>
+
+
+const std::string EmptyList = "\r\n";
+
+namespace {
+
+const char ListQuerySeparator = '?';
+
+struct HashTableUnref {
+    void operator() (GHashTable* hashTable) { g_hash_table_unref(hashTable); }
+};
+typedef std::unique_ptr<GHashTable, HashTableUnref> ParamsPtr;
+
+bool ParseUnsigned(GHashTable* params, const char* name, std::optional<uint64_t>* out)
+{
+    const gchar* value = static_cast<const gchar*>(g_hash_table_lookup(params, name));
+    if(!value)
+        return true;
+
+    guint64 number;
+    if(!g_ascii_string_to_unsigned(value, 10, 0, G_MAXUINT64, &number, nullptr))
+        return false;
+
+    *out = number;
+
+    return true;
+}
+
+}
+
+void MountpointListCacheBuilder::reserve(std::string::size_type listSize, size_t itemsCount)
+{
+    _list.reserve(listSize);
+    _items.reserve(itemsCount);
+}
+
+void MountpointListCacheBuilder::add(
+    std::string_view line,
+    std::string_view::size_type nameOffset,
+    uint64_t timestamp)
+{
+    std::string_view::size_type nameEnd = line.find(':', nameOffset);
+    if(nameEnd == std::string_view::npos)
+        nameEnd = line.size();
+
+    _items.push_back(Item {
+        _list.size(),
+        line.size(),
+        _list.size() + nameOffset,
+        nameEnd - nameOffset,
+        timestamp });
+
+    _list += line;
+}
+
+MountpointListCache MountpointListCacheBuilder::build(uint64_t version)
+{
+    // index has to refer to final list buffer
+    ListCachePtr listPtr = std::make_shared<const std::string>(std::move(_list));
+    const std::string_view list = *listPtr;
+
+    std::shared_ptr<ListIndex> indexPtr = std::make_shared<ListIndex>();
+    ListIndex& index = *indexPtr;
+
+    index.byName.reserve(_items.size());
+    for(const Item& item: _items) {
+        index.byName.push_back(ListIndexEntry {
+            list.substr(item.nameOffset, item.nameSize),
+            item.timestamp,
+            list.substr(item.lineOffset, item.lineSize) });
+    }
+    _items.clear();
+
+    auto nameLess = [] (const ListIndexEntry& l, const ListIndexEntry& r) {
+        return l.name < r.name;
+    };
+    if(!std::is_sorted(index.byName.begin(), index.byName.end(), nameLess))
+        std::sort(index.byName.begin(), index.byName.end(), nameLess);
+
+    index.byTime.reserve(index.byName.size());
+    for(const ListIndexEntry& entry: index.byName)
+        index.byTime.push_back(&entry);
+    std::stable_sort(
+        index.byTime.begin(),
+        index.byTime.end(),
+        [] (const ListIndexEntry* l, const ListIndexEntry* r) {
+            return l->timestamp < r->timestamp;
+        });
+
+    return MountpointListCache { version, std::move(listPtr), std::move(indexPtr) };
+}
+
+std::pair<std::string_view, std::string_view> SplitListUri(std::string_view uri)
+{
+    const std::string_view::size_type separatorPos = uri.find(ListQuerySeparator);
+    if(separatorPos == std::string_view::npos)
+        return { uri, std::string_view() };
+
+    return { uri.substr(0, separatorPos), uri.substr(separatorPos + 1) };
+}
+
+bool ParseListQuery(std::string_view query, ListQuery* out)
+{
+    ParamsPtr paramsPtr(
+        g_uri_parse_params(query.data(), query.size(), "&", G_URI_PARAMS_NONE, nullptr));
+    if(!paramsPtr)
+        return false;
+
+    GHashTable* params = paramsPtr.get();
+
+    ListQuery listQuery;
+
+    if(const gchar* prefix = static_cast<const gchar*>(g_hash_table_lookup(params, "prefix"))) {
+        GCharPtr escapedPrefixPtr(g_uri_escape_string(prefix, nullptr, false));
+        listQuery.prefix = escapedPrefixPtr.get();
+    }
+
+    std::optional<uint64_t> offset;
+    std::optional<uint64_t> limit;
+    if(!ParseUnsigned(params, "from", &listQuery.from) ||
+        !ParseUnsigned(params, "to", &listQuery.to) ||
+        !ParseUnsigned(params, "offset", &offset) ||
+        !ParseUnsigned(params, "limit", &limit))
+    {
+        return false;
+    }
+
+    if(offset)
+        listQuery.offset = *offset;
+    if(limit)
+        listQuery.limit = *limit;
+
+    *out = std::move(listQuery);
+
+    return true;
+}
+
+std::string SelectListPage(const MountpointListCache& listCache, const ListQuery& query)
+{
+    if(!listCache.index || query.limit == 0)
+        return EmptyList;
+
+    const ListIndex& index = *listCache.index;
+
+    std::string page;
+    size_t skipped = 0;
+    size_t taken = 0;
+    auto addEntry = [&query, &page, &skipped, &taken] (const ListIndexEntry& entry) -> bool {
+        if(skipped < query.offset) {
+            ++skipped;
+        } else {
+            page += entry.line;
+            ++taken;
+        }
+        return taken < query.limit;
+    };
+
+    if(query.from || query.to) {
+        auto it =
+            query.from ?
+                std::lower_bound(
+                    index.byTime.begin(),
+                    index.byTime.end(),
+                    *query.from,
+                    [] (const ListIndexEntry* entry, uint64_t from) {
+                        return entry->timestamp < from;
+                    }) :
+                index.byTime.begin();
+        if(query.prefix.empty()) {
+            skipped = std::min<size_t>(query.offset, index.byTime.end() - it);
+            it += skipped;
+        }
+        for(; it != index.byTime.end() && (!query.to || (*it)->timestamp <= *query.to); ++it) {
+            if(!(*it)->name.starts_with(query.prefix))
+                continue;
+            if(!addEntry(**it))
+                break;
+        }
+    } else {
+        auto it = std::lower_bound(
+            index.byName.begin(),
+            index.byName.end(),
+            query.prefix,
+            [] (const ListIndexEntry& entry, const std::string& prefix) {
+                return entry.name < prefix;
+            });
+        // all entries with the same prefix are adjacent
+        skipped = std::min<size_t>(query.offset, index.byName.end() - it);
+        it += skipped;
+        for(; it != index.byName.end() && it->name.starts_with(query.prefix); ++it) {
+            if(!addEntry(*it))
+                break;
+        }
+    }
+
+    if(page.empty())
+        return EmptyList;
+
+    return page;
+}
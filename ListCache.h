@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// LIST response body without items
+extern const std::string EmptyList;
+
+// immutable list shared by all LIST responses
+typedef std::shared_ptr<const std::string> ListCachePtr;
+
+struct ListIndexEntry {
+    std::string_view name; // escaped item name without streamer prefix
+    uint64_t timestamp;
+    std::string_view line;
+};
+
+struct ListIndex {
+    std::vector<ListIndexEntry> byName;
+    std::vector<const ListIndexEntry*> byTime;
+};
+
+struct MountpointListCache {
+    uint64_t version = 0;
+    ListCachePtr list;
+    std::shared_ptr<const ListIndex> index; // refers to list content
+};
+
+class MountpointListCacheBuilder
+{
+public:
+    void reserve(std::string::size_type listSize, size_t itemsCount);
+
+    // line is expected in "streamer/name: value\r\n" form,
+    // nameOffset is position of name in line
+    void add(std::string_view line, std::string_view::size_type nameOffset, uint64_t timestamp = 0);
+
+    MountpointListCache build(uint64_t version);
+
+private:
+    struct Item {
+        std::string::size_type lineOffset;
+        std::string::size_type lineSize;
+        std::string::size_type nameOffset;
+        std::string::size_type nameSize;
+        uint64_t timestamp;
+    };
+
+    std::string _list;
+    std::vector<Item> _items;
+};
+
+struct ListQuery {
+    std::string prefix; // escaped
+    std::optional<uint64_t> from; // unix time
+    std::optional<uint64_t> to; // unix time
+    size_t offset = 0;
+    size_t limit = std::numeric_limits<size_t>::max();
+};
+
+// "streamer?offset=0&limit=100" -> ("streamer", "offset=0&limit=100")
+std::pair<std::string_view, std::string_view> SplitListUri(std::string_view uri);
+
+bool ParseListQuery(std::string_view query, ListQuery*);
+
+// O(log n + page) if only one of name prefix or time range is used
+std::string SelectListPage(const MountpointListCache&, const ListQuery&);
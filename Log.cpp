@@ -1,19 +1,77 @@
 #include "Log.h"
 
 #include <spdlog/spdlog.h>
+#include <spdlog/async.h>
+#include <spdlog/async_logger.h>
+#include <spdlog/pattern_formatter.h>
 #include <spdlog/sinks/stdout_sinks.h>
 
 
+namespace {
+
+const char LoggerName[] = "ReStreamer";
+
+enum {
+    LOG_QUEUE_SIZE = 8192, // messages
+};
+
+// session loggers are named after session context,
+// so it's "[context] [ReStreamer]" for them and "[ReStreamer]" for main logger
+class LoggerNameFormatter : public spdlog::custom_flag_formatter
+{
+public:
+    void format(const spdlog::details::log_msg& msg, const std::tm&, spdlog::memory_buf_t& dest) override
+    {
+        const spdlog::string_view_t name = msg.logger_name;
+        if(name != LoggerName) {
+            dest.push_back('[');
+            dest.append(name.data(), name.data() + name.size());
+            dest.append(std::string_view("] "));
+        }
+
+        dest.append(std::string_view("["));
+        dest.append(std::string_view(LoggerName));
+        dest.push_back(']');
+    }
+
+    std::unique_ptr<custom_flag_formatter> clone() const override
+    {
+        return std::make_unique<LoggerNameFormatter>();
+    }
+};
+
+}
+
+static const std::chrono::steady_clock::time_point ProcessStartedAt = std::chrono::steady_clock::now();
+
+// thread pool has to outlive logger to flush queued messages on exit
+static std::shared_ptr<spdlog::details::thread_pool> ThreadPool;
+static std::shared_ptr<spdlog::sinks::sink> Sink;
 static std::shared_ptr<spdlog::logger> Logger;
 
 
 void InitReStreamerLogger(spdlog::level::level_enum level)
 {
     if(!Logger) {
-        Logger = spdlog::stdout_logger_st("ReStreamer");
+        ThreadPool = std::make_shared<spdlog::details::thread_pool>(LOG_QUEUE_SIZE, 1);
+
+        // the only writer is thread pool thread
+        Sink = std::make_shared<spdlog::sinks::stdout_sink_st>();
+
+        auto formatter = std::make_unique<spdlog::pattern_formatter>();
 #ifdef SNAPCRAFT_BUILD
-        Logger->set_pattern("[%n] [%l] %v");
+        formatter->add_flag<LoggerNameFormatter>('*').set_pattern("%* [%l] %v");
+#else
+        formatter->add_flag<LoggerNameFormatter>('*').set_pattern("[%Y-%m-%d %H:%M:%S.%e] %* [%l] %v");
 #endif
+        Sink->set_formatter(std::move(formatter));
+
+        // main loop should never wait for stdout, so oldest messages are dropped on overflow
+        Logger = std::make_shared<spdlog::async_logger>(
+            LoggerName,
+            Sink,
+            ThreadPool,
+            spdlog::async_overflow_policy::overrun_oldest);
     }
 
     Logger->set_level(level);
@@ -39,18 +97,28 @@ std::shared_ptr<spdlog::logger> MakeReStreamerLogger(const std::string& context)
     if(context.empty()) {
         return logger;
     } else {
-        // have to go long road to avoid issues with duplicated names in loggers registry
-        std::shared_ptr<spdlog::logger> loggerWithContext = std::make_shared<spdlog::logger>(
-            logger->name(),
-            std::make_shared<spdlog::sinks::stdout_sink_st>());
+        // not registered, so duplicated names are fine;
+        // shares sink and queue with main logger
+        std::shared_ptr<spdlog::logger> loggerWithContext = std::make_shared<spdlog::async_logger>(
+            context,
+            Sink,
+            ThreadPool,
+            spdlog::async_overflow_policy::overrun_oldest);
         loggerWithContext->set_level(logger->level());
 
-#ifdef SNAPCRAFT_BUILD
-        loggerWithContext->set_pattern("[" + context + "] [%n] [%l] %v");
-#else
-        loggerWithContext->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [" + context + "] [%n] [%l] %v");
-#endif
-
         return loggerWithContext;
     }
 }
+
+void LogStartupPhase(std::string_view phase, std::chrono::steady_clock::time_point phaseStartedAt)
+{
+    using std::chrono::duration_cast;
+    using std::chrono::milliseconds;
+
+    const auto now = std::chrono::steady_clock::now();
+    ReStreamerLog()->info(
+        "{} took {} ms ({} ms since start)",
+        phase,
+        duration_cast<milliseconds>(now - phaseStartedAt).count(),
+        duration_cast<milliseconds>(now - ProcessStartedAt).count());
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
+#include <string_view>
 
 #include <spdlog/spdlog.h>
 
@@ -8,3 +10,6 @@
 void InitReStreamerLogger(spdlog::level::level_enum level);
 const std::shared_ptr<spdlog::logger>& ReStreamerLog();
 std::shared_ptr<spdlog::logger> MakeReStreamerLogger(const std::string& context);
+
+// logs phase duration and time passed since process start
+void LogStartupPhase(std::string_view phase, std::chrono::steady_clock::time_point phaseStartedAt);
@@ -0,0 +1,192 @@
+#include "MainLoopProfiler.h"
+
+#include <array>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string_view>
+
+#include <spdlog/fmt/fmt.h>
+
+#include "Log.h"
+
+
+namespace {
+
+const auto Log = ReStreamerLog;
+
+// histogram upper bounds, microseconds
+const std::array<gint64, 8> BucketBounds = { 100, 1000, 5000, 10000, 50000, 100000, 500000, 1000000 };
+
+struct Histogram {
+    std::array<uint64_t, BucketBounds.size() + 1> buckets {}; // the last one is +Inf
+    uint64_t count = 0;
+    gint64 sum = 0; // microseconds
+
+    void add(gint64 duration);
+};
+
+void Histogram::add(gint64 duration)
+{
+    size_t bucket = 0;
+    while(bucket < BucketBounds.size() && duration > BucketBounds[bucket])
+        ++bucket;
+
+    ++buckets[bucket];
+    ++count;
+    sum += duration;
+}
+
+struct Profiler {
+    GPollFunc defaultPoll;
+    gint64 slowDispatchThreshold; // microseconds
+
+    gint64 pollReturnedAt = 0;
+
+    // slowest instrumented callback of current iteration
+    const char* slowestOrigin = nullptr;
+    gint64 slowestDuration = 0;
+
+    Histogram iterations;
+    std::map<std::string_view, Histogram> dispatches; // origin -> histogram
+};
+
+double Seconds(gint64 microseconds)
+{
+    return microseconds / 1000000.;
+}
+
+void AppendHistogram(
+    std::string* out,
+    std::string_view name,
+    std::string_view labels,
+    const Histogram& histogram)
+{
+    auto outIt = std::back_inserter(*out);
+    const std::string_view separator = labels.empty() ? "" : ",";
+
+    uint64_t cumulative = 0;
+    for(size_t bucket = 0; bucket < BucketBounds.size(); ++bucket) {
+        cumulative += histogram.buckets[bucket];
+        fmt::format_to(
+            outIt,
+            "{}_bucket{{{}{}le=\"{}\"}} {}\n",
+            name, labels, separator, Seconds(BucketBounds[bucket]), cumulative);
+    }
+    fmt::format_to(outIt, "{}_bucket{{{}{}le=\"+Inf\"}} {}\n", name, labels, separator, histogram.count);
+
+    if(labels.empty()) {
+        fmt::format_to(outIt, "{}_sum {}\n", name, Seconds(histogram.sum));
+        fmt::format_to(outIt, "{}_count {}\n", name, histogram.count);
+    } else {
+        fmt::format_to(outIt, "{}_sum{{{}}} {}\n", name, labels, Seconds(histogram.sum));
+        fmt::format_to(outIt, "{}_count{{{}}} {}\n", name, labels, histogram.count);
+    }
+}
+
+}
+
+// main loop thread is the only user
+static std::unique_ptr<Profiler> ProfilerInstance;
+
+
+// everything between poll return and next poll is spent in check/dispatch/prepare
+static gint ProfilingPoll(GPollFD* fds, guint nfds, gint timeout)
+{
+    Profiler& profiler = *ProfilerInstance;
+
+    if(profiler.pollReturnedAt) {
+        const gint64 iterationDuration = g_get_monotonic_time() - profiler.pollReturnedAt;
+        profiler.iterations.add(iterationDuration);
+
+        if(iterationDuration >= profiler.slowDispatchThreshold) {
+            if(profiler.slowestOrigin) {
+                Log()->warn(
+                    "Main loop was blocked for {} ms. Slowest instrumented callback: \"{}\" ({} ms)",
+                    iterationDuration / 1000,
+                    profiler.slowestOrigin,
+                    profiler.slowestDuration / 1000);
+            } else {
+                Log()->warn(
+                    "Main loop was blocked for {} ms outside of instrumented callbacks",
+                    iterationDuration / 1000);
+            }
+        }
+    }
+
+    profiler.slowestOrigin = nullptr;
+    profiler.slowestDuration = 0;
+
+    const gint result = profiler.defaultPoll(fds, nfds, timeout);
+
+    profiler.pollReturnedAt = g_get_monotonic_time();
+
+    return result;
+}
+
+void EnableMainLoopProfiler(GMainContext* context, std::chrono::milliseconds slowDispatchThreshold)
+{
+    if(ProfilerInstance)
+        return;
+
+    ProfilerInstance = std::make_unique<Profiler>();
+    ProfilerInstance->defaultPoll = g_main_context_get_poll_func(context);
+    ProfilerInstance->slowDispatchThreshold =
+        std::chrono::duration_cast<std::chrono::microseconds>(slowDispatchThreshold).count();
+
+    g_main_context_set_poll_func(context, ProfilingPoll);
+
+    Log()->info(
+        "Main loop profiler enabled. Slow dispatch threshold: {} ms",
+        slowDispatchThreshold.count());
+}
+
+void AppendMainLoopProfilerMetrics(std::string* out)
+{
+    if(!ProfilerInstance)
+        return;
+
+    const Profiler& profiler = *ProfilerInstance;
+
+    out->append(
+        "# HELP restreamer_main_loop_iteration_seconds Time spent by main loop outside of poll\n"
+        "# TYPE restreamer_main_loop_iteration_seconds histogram\n");
+    AppendHistogram(out, "restreamer_main_loop_iteration_seconds", std::string_view(), profiler.iterations);
+
+    out->append(
+        "# HELP restreamer_main_loop_dispatch_seconds Duration of instrumented main loop callbacks\n"
+        "# TYPE restreamer_main_loop_dispatch_seconds histogram\n");
+    for(const auto& [origin, histogram]: profiler.dispatches) {
+        AppendHistogram(
+            out,
+            "restreamer_main_loop_dispatch_seconds",
+            fmt::format("origin=\"{}\"", origin),
+            histogram);
+    }
+}
+
+DispatchScope::DispatchScope(const char* origin) noexcept :
+    _origin(origin),
+    _startedAt(ProfilerInstance ? g_get_monotonic_time() : 0)
+{
+}
+
+DispatchScope::~DispatchScope()
+{
+    if(!_startedAt)
+        return;
+
+    Profiler& profiler = *ProfilerInstance;
+
+    const gint64 duration = g_get_monotonic_time() - _startedAt;
+    profiler.dispatches[_origin].add(duration);
+
+    // nested scopes are included into outer ones, so outer one wins on equal duration
+    if(duration >= profiler.slowestDuration) {
+        profiler.slowestOrigin = _origin;
+        profiler.slowestDuration = duration;
+    }
+
+    if(duration >= profiler.slowDispatchThreshold)
+        Log()->warn("\"{}\" blocked main loop for {} ms", _origin, duration / 1000);
+}
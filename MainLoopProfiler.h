@@ -0,0 +1,31 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+#include <glib.h>
+
+
+// opt-in profiling of main loop iterations and instrumented callbacks,
+// should be enabled only once and before main loop is started
+void EnableMainLoopProfiler(GMainContext*, std::chrono::milliseconds slowDispatchThreshold);
+
+// appends dispatch duration histograms in Prometheus text format,
+// appends nothing if profiler is not enabled
+void AppendMainLoopProfilerMetrics(std::string* out);
+
+// measures callback it's created in, does nothing if profiler is not enabled
+class DispatchScope
+{
+public:
+    // origin is expected to be string literal
+    explicit DispatchScope(const char* origin) noexcept;
+    ~DispatchScope();
+
+    DispatchScope(const DispatchScope&) = delete;
+    DispatchScope& operator=(const DispatchScope&) = delete;
+
+private:
+    const char *const _origin;
+    const gint64 _startedAt; // monotonic time, 0 if profiler is not enabled
+};
@@ -0,0 +1,173 @@
+#include "MetricsServer.h"
+
+#include <string_view>
+
+#include <CxxPtr/GlibPtr.h>
+
+#include "Log.h"
+
+
+namespace {
+
+enum {
+    MAX_REQUEST_SIZE = 4096,
+};
+
+const auto Log = ReStreamerLog;
+
+const std::string_view MetricsPath = "/metrics";
+
+}
+
+struct MetricsServer::Connection {
+    Connection(GSocketConnection* connection, const std::shared_ptr<const CollectMetrics>& collectMetrics) :
+        connectionPtr(G_SOCKET_CONNECTION(g_object_ref(connection))), collectMetrics(collectMetrics) {}
+
+    std::unique_ptr<GSocketConnection, ObjectUnref> connectionPtr;
+    const std::shared_ptr<const CollectMetrics> collectMetrics;
+
+    char request[MAX_REQUEST_SIZE];
+    size_t requestSize = 0;
+    std::string response;
+};
+
+MetricsServer::MetricsServer(
+    unsigned short port,
+    bool bindToLoopbackOnly,
+    const CollectMetrics& collectMetrics) noexcept :
+    _port(port),
+    _bindToLoopbackOnly(bindToLoopbackOnly),
+    _collectMetrics(std::make_shared<const CollectMetrics>(collectMetrics))
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    if(_servicePtr)
+        g_socket_service_stop(_servicePtr.get());
+}
+
+bool MetricsServer::init() noexcept
+{
+    std::unique_ptr<GSocketService, ObjectUnref> servicePtr(g_socket_service_new());
+    GSocketListener* listener = G_SOCKET_LISTENER(servicePtr.get());
+
+    GError* error = nullptr;
+    gboolean added;
+    if(_bindToLoopbackOnly) {
+        std::unique_ptr<GInetAddress, ObjectUnref> loopbackPtr(g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4));
+        std::unique_ptr<GSocketAddress, ObjectUnref> addressPtr(g_inet_socket_address_new(loopbackPtr.get(), _port));
+        added = g_socket_listener_add_address(
+            listener,
+            addressPtr.get(),
+            G_SOCKET_TYPE_STREAM,
+            G_SOCKET_PROTOCOL_TCP,
+            nullptr,
+            nullptr,
+            &error);
+    } else {
+        added = g_socket_listener_add_inet_port(listener, _port, nullptr, &error);
+    }
+
+    if(!added) {
+        GErrorPtr errorPtr(error);
+        Log()->error("Failed to listen metrics port {}: {}", _port, error->message);
+        return false;
+    }
+
+    g_signal_connect(servicePtr.get(), "incoming", G_CALLBACK(onIncoming), this);
+    g_socket_service_start(servicePtr.get());
+
+    _servicePtr = std::move(servicePtr);
+
+    Log()->info("Metrics are available on port {}", _port);
+
+    return true;
+}
+
+gboolean MetricsServer::onIncoming(
+    GSocketService*,
+    GSocketConnection* socketConnection,
+    GObject*,
+    gpointer userData)
+{
+    MetricsServer* self = static_cast<MetricsServer*>(userData);
+
+    readRequest(new Connection(socketConnection, self->_collectMetrics));
+
+    return TRUE;
+}
+
+void MetricsServer::readRequest(Connection* connection)
+{
+    g_input_stream_read_async(
+        g_io_stream_get_input_stream(G_IO_STREAM(connection->connectionPtr.get())),
+        connection->request + connection->requestSize,
+        sizeof(connection->request) - connection->requestSize,
+        G_PRIORITY_DEFAULT,
+        nullptr,
+        onRequestRead,
+        connection);
+}
+
+void MetricsServer::onRequestRead(GObject* source, GAsyncResult* result, gpointer userData)
+{
+    std::unique_ptr<Connection> connectionPtr(static_cast<Connection*>(userData));
+
+    const gssize read = g_input_stream_read_finish(G_INPUT_STREAM(source), result, nullptr);
+    if(read <= 0)
+        return;
+
+    connectionPtr->requestSize += read;
+
+    const std::string_view request(connectionPtr->request, connectionPtr->requestSize);
+    if(request.find("\r\n\r\n") == std::string_view::npos) {
+        if(connectionPtr->requestSize < sizeof(connectionPtr->request))
+            readRequest(connectionPtr.release());
+        return;
+    }
+
+    // "GET /metrics HTTP/1.1" or "GET /metrics?... HTTP/1.1"
+    const std::string_view get = "GET ";
+    std::string_view target;
+    if(request.starts_with(get)) {
+        target = request.substr(get.size());
+        target = target.substr(0, target.find_first_of(" ?\r"));
+    }
+
+    std::string& response = connectionPtr->response;
+    if(target == MetricsPath) {
+        const std::string body = (*connectionPtr->collectMetrics)();
+        response =
+            "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: " + std::to_string(body.size()) + "\r\n"
+            "Connection: close\r\n"
+            "\r\n";
+        response += body;
+    } else {
+        response =
+            "HTTP/1.0 404 Not Found\r\n"
+            "Content-Length: 0\r\n"
+            "Connection: close\r\n"
+            "\r\n";
+    }
+
+    GSocketConnection* socketConnection = connectionPtr->connectionPtr.get();
+    g_output_stream_write_all_async(
+        g_io_stream_get_output_stream(G_IO_STREAM(socketConnection)),
+        response.data(),
+        response.size(),
+        G_PRIORITY_DEFAULT,
+        nullptr,
+        onResponseWritten,
+        connectionPtr.release());
+}
+
+void MetricsServer::onResponseWritten(GObject* source, GAsyncResult* result, gpointer userData)
+{
+    std::unique_ptr<Connection> connectionPtr(static_cast<Connection*>(userData));
+
+    g_output_stream_write_all_finish(G_OUTPUT_STREAM(source), result, nullptr, nullptr);
+    g_io_stream_close(G_IO_STREAM(connectionPtr->connectionPtr.get()), nullptr, nullptr);
+}
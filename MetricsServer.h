@@ -0,0 +1,42 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <gio/gio.h>
+
+
+// minimal HTTP server exposing metrics in Prometheus text format on "/metrics"
+class MetricsServer
+{
+public:
+    typedef std::function<std::string ()> CollectMetrics;
+
+    MetricsServer(
+        unsigned short port,
+        bool bindToLoopbackOnly,
+        const CollectMetrics&) noexcept;
+    ~MetricsServer();
+
+    bool init() noexcept;
+
+private:
+    struct Connection;
+
+    static gboolean onIncoming(GSocketService*, GSocketConnection*, GObject*, gpointer userData);
+    static void readRequest(Connection*);
+    static void onRequestRead(GObject*, GAsyncResult*, gpointer userData);
+    static void onResponseWritten(GObject*, GAsyncResult*, gpointer userData);
+
+private:
+    struct ObjectUnref {
+        void operator() (gpointer object) { g_object_unref(object); }
+    };
+
+    const unsigned short _port;
+    const bool _bindToLoopbackOnly;
+    const std::shared_ptr<const CollectMetrics> _collectMetrics; // shared with pending connections
+
+    std::unique_ptr<GSocketService, ObjectUnref> _servicePtr;
+};
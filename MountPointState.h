@@ -0,0 +1,14 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+
+
+// shared by mount point and leases of its peers,
+// so it stays valid while peers are alive, whatever happens to mount point
+struct MountPointState {
+    unsigned peers = 0; // alive ones
+    std::chrono::steady_clock::time_point idleSince = std::chrono::steady_clock::now(); // since last peer release
+    bool retired = false; // streamer was removed or changed on reload
+};
+typedef std::shared_ptr<MountPointState> MountPointStatePtr;
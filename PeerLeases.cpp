@@ -0,0 +1,181 @@
+#include "PeerLeases.h"
+
+#include <cassert>
+
+#include "Log.h"
+
+
+namespace {
+
+const auto Log = ReStreamerLog;
+
+}
+
+PeerLeases::PeerLeases(SessionsSharedData* sharedData) :
+    _sharedData(sharedData)
+{
+}
+
+PeerLeases::~PeerLeases()
+{
+    for(const auto& [cseq, lease]: _describeLeases)
+        release(lease);
+
+    for(const auto& [mediaSession, lease]: _leases)
+        release(lease);
+}
+
+void PeerLeases::acquire(const PeerLease& lease) noexcept
+{
+    if(lease.mountPoint)
+        ++lease.mountPoint->peers;
+
+    auto& streamersPeers = _sharedData->streamersPeers;
+    auto it = streamersPeers.find(lease.streamerName);
+    if(it == streamersPeers.end())
+        it = streamersPeers.emplace(lease.streamerName, 0).first;
+    ++it->second;
+    ++_sharedData->peersCount;
+}
+
+void PeerLeases::release(const PeerLease& lease) noexcept
+{
+    if(lease.mountPoint && --lease.mountPoint->peers == 0)
+        lease.mountPoint->idleSince = std::chrono::steady_clock::now();
+
+    auto& streamersPeers = _sharedData->streamersPeers;
+    auto it = streamersPeers.find(lease.streamerName);
+    assert(it != streamersPeers.end());
+    if(it != streamersPeers.end() && --it->second == 0)
+        streamersPeers.erase(it);
+    --_sharedData->peersCount;
+}
+
+void PeerLeases::describeStarted(rtsp::CSeq cseq, const StreamerRoute* route) noexcept
+{
+    assert(!_describeCSeq && !_recordMediaSession);
+    _describeCSeq = cseq;
+    _route = route;
+}
+
+void PeerLeases::describeFinished(bool handled) noexcept
+{
+    assert(_describeCSeq);
+    const rtsp::CSeq cseq = *_describeCSeq;
+    _describeCSeq.reset();
+    _route = nullptr;
+
+    if(handled)
+        return;
+
+    auto it = _describeLeases.find(cseq);
+    if(it != _describeLeases.end()) {
+        release(it->second);
+        _describeLeases.erase(it);
+    }
+}
+
+void PeerLeases::recordStarted(const rtsp::MediaSessionId& mediaSession, const StreamerRoute* route) noexcept
+{
+    assert(!_describeCSeq && !_recordMediaSession);
+    _recordMediaSession = mediaSession;
+    _route = route;
+}
+
+void PeerLeases::recordFinished() noexcept
+{
+    assert(_recordMediaSession);
+    _recordMediaSession.reset();
+    _route = nullptr;
+}
+
+std::unique_ptr<WebRTCPeer> PeerLeases::createPeer(
+    const CreatePeer& createPeer,
+    const std::string& uri) noexcept
+{
+    if(!_describeCSeq && !_recordMediaSession) {
+        Log()->error("Peer for \"{}\" requested outside of DESCRIBE or RECORD", uri);
+        assert(false);
+        return nullptr;
+    }
+
+    if(!_route)
+        return nullptr;
+
+    PeerLease lease;
+    std::unique_ptr<WebRTCPeer> peerPtr = createPeer(*_route, uri, &lease);
+    if(!peerPtr)
+        return nullptr;
+
+    acquire(lease);
+
+    if(_recordMediaSession) {
+        auto [it, inserted] = _leases.try_emplace(*_recordMediaSession, lease);
+        if(!inserted) {
+            release(it->second);
+            it->second = std::move(lease);
+        }
+    } else {
+        _describeLeases.emplace(*_describeCSeq, std::move(lease));
+    }
+
+    return peerPtr;
+}
+
+bool PeerLeases::admitViewer(
+    const Config& config,
+    const StreamerRoute& route,
+    rtsp::StatusCode* statusCode,
+    const char** reasonPhrase) noexcept
+{
+    // every DESCRIBE creates new peer, so it needs seat of its own
+    unsigned streamerPeers = 0;
+    auto peersIt = _sharedData->streamersPeers.find(route.name);
+    if(peersIt != _sharedData->streamersPeers.end())
+        streamerPeers = peersIt->second;
+
+    const std::optional<unsigned>& streamerMaxViewers = route.config->maxViewers;
+    if(streamerMaxViewers && streamerPeers >= *streamerMaxViewers) {
+        Log()->warn("Viewers limit ({}) of streamer \"{}\" reached", *streamerMaxViewers, route.name);
+        *statusCode = rtsp::StatusCode::NOT_ENOUGH_BANDWIDTH;
+        *reasonPhrase = "Not Enough Bandwidth";
+    } else if(config.maxViewers && _sharedData->peersCount >= *config.maxViewers) {
+        Log()->warn("Total viewers limit ({}) reached", *config.maxViewers);
+        *statusCode = rtsp::StatusCode::SERVICE_UNAVAILABLE;
+        *reasonPhrase = "Service Unavailable";
+    } else
+        return true;
+
+    ++_sharedData->rejectedViewers;
+
+    return false;
+}
+
+void PeerLeases::onResponse(const rtsp::Response& response) noexcept
+{
+    auto it = _describeLeases.find(response.cseq);
+    if(it == _describeLeases.end())
+        return;
+
+    const rtsp::MediaSessionId& mediaSession = rtsp::ResponseSession(response);
+    if(response.statusCode != rtsp::StatusCode::OK || mediaSession.empty()) {
+        release(it->second);
+    } else {
+        const bool inserted = _leases.try_emplace(mediaSession, std::move(it->second)).second;
+        assert(inserted);
+        if(!inserted)
+            release(it->second);
+    }
+
+    _describeLeases.erase(it);
+}
+
+void PeerLeases::release(const rtsp::MediaSessionId& mediaSession) noexcept
+{
+    auto it = _leases.find(mediaSession);
+    if(it == _leases.end())
+        return;
+
+    release(it->second);
+    _leases.erase(it);
+}
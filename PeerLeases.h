@@ -0,0 +1,69 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "RtspParser/RtspParser.h"
+#include "RtStreaming/WebRTCPeer.h"
+
+#include "SessionsSharedData.h"
+
+
+// leases of peers created by session, keyed by media session,
+// so they are released on TEARDOWN or when session is closed
+class PeerLeases
+{
+public:
+    typedef std::function<
+        std::unique_ptr<WebRTCPeer> (
+            const StreamerRoute&,
+            const std::string& uri,
+            PeerLease*)> CreatePeer;
+
+    explicit PeerLeases(SessionsSharedData*);
+    PeerLeases(const PeerLeases&) = delete;
+    PeerLeases& operator = (const PeerLeases&) = delete;
+    ~PeerLeases();
+
+    // peer is created synchronously while DESCRIBE is handled,
+    // and its media session becomes known from the response.
+    // route is the one request was resolved to, nullptr if streamer is unknown
+    void describeStarted(rtsp::CSeq, const StreamerRoute*) noexcept;
+    void describeFinished(bool handled) noexcept;
+
+    // peer is created synchronously while record to subscriber is started
+    void recordStarted(const rtsp::MediaSessionId&, const StreamerRoute*) noexcept;
+    void recordFinished() noexcept;
+
+    std::unique_ptr<WebRTCPeer> createPeer(const CreatePeer&, const std::string& uri) noexcept;
+
+    // checks viewers limits against live peers of all sessions,
+    // fills status of response to reject viewer with if it can't be admitted
+    bool admitViewer(
+        const Config&,
+        const StreamerRoute&,
+        rtsp::StatusCode* statusCode,
+        const char** reasonPhrase) noexcept;
+
+    // has to see every response sent by session
+    void onResponse(const rtsp::Response&) noexcept;
+
+    void release(const rtsp::MediaSessionId&) noexcept;
+
+private:
+    void acquire(const PeerLease&) noexcept;
+    void release(const PeerLease&) noexcept;
+
+private:
+    SessionsSharedData *const _sharedData;
+
+    std::optional<rtsp::CSeq> _describeCSeq;
+    std::optional<rtsp::MediaSessionId> _recordMediaSession;
+    const StreamerRoute* _route = nullptr; // of started DESCRIBE or record
+
+    std::map<rtsp::CSeq, PeerLease> _describeLeases; // DESCRIBE CSeq -> lease, until response is sent
+    std::map<rtsp::MediaSessionId, PeerLease> _leases;
+};
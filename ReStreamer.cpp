@@ -1,10 +1,16 @@
 #include "ReStreamer.h"
 
+#include <atomic>
+#include <csignal>
 #include <deque>
+#include <list>
 #include <map>
+#include <set>
 #include <string>
 #include <chrono>
 
+#include <glib-unix.h>
+
 #include <CxxPtr/GlibPtr.h>
 #include <CxxPtr/GioPtr.h>
 #include <CxxPtr/libwebsocketsPtr.h>
@@ -32,13 +38,22 @@
 #include "RtStreaming/GstRtStreaming/GstV4L2ReStreamer.h"
 
 #include "Log.h"
+#include "MainLoopProfiler.h"
+#include "MetricsServer.h"
 #include "Session.h"
 #include "SignallingClientSession.h"
+#include "stun.h"
 
 
 namespace {
 
 const unsigned AuthTokenCleanupInterval = 15; // seconds
+const unsigned MountsCleanupInterval = 10; // seconds
+const unsigned MainLoopProbeInterval = 1000; // milliseconds
+const std::chrono::seconds PublicIPRecheckInterval(300);
+
+// how long file player pipeline without viewers is kept alive
+const std::chrono::seconds FilePlayerIdleLinger(30);
 
 enum {
     MAX_FILES_TO_CLEANUP = 10,
@@ -55,7 +70,7 @@ enum class ListType {
     Agent,
 };
 
-std::string GenerateList(const Config& config, ListType type) {
+ListCachePtr GenerateList(const Config& config, ListType type) {
     const bool addPublicOnly = (type == ListType::Public) || (type == ListType::Agent);
     const bool skipProxy = type == ListType::Agent;
     std::string list;
@@ -82,7 +97,7 @@ std::string GenerateList(const Config& config, ListType type) {
         }
     }
 
-    return list;
+    return std::make_shared<const std::string>(std::move(list));
 }
 
 void OnNewAuthToken(
@@ -90,7 +105,8 @@ void OnNewAuthToken(
     const std::string& token,
     std::chrono::steady_clock::time_point expiresAt)
 {
-    sessionsSharedData->authTokens.emplace(token, Session::AuthTokenData { expiresAt });
+    if(sessionsSharedData->authTokens.emplace(token, Session::AuthTokenData { expiresAt }).second)
+        sessionsSharedData->authTokensExpirations.push(AuthTokenExpiration { expiresAt, token });
 }
 
 void CleanupAuthTokens(Session::SharedData* sessionsSharedData)
@@ -98,12 +114,19 @@ void CleanupAuthTokens(Session::SharedData* sessionsSharedData)
     const auto now = std::chrono::steady_clock::now();
 
     auto& authTokens = sessionsSharedData->authTokens;
-    for(auto it = authTokens.begin(); it != authTokens.end();) {
-        if(it->second.expiresAt < now)
-            it = authTokens.erase(it);
-        else
-            ++it;
+    auto& expirations = sessionsSharedData->authTokensExpirations;
+    // every token has exactly one heap entry, so only expired tokens are touched
+    uint64_t expired = 0;
+    while(!expirations.empty() && expirations.top().expiresAt < now) {
+        authTokens.erase(expirations.top().token);
+        expirations.pop();
+        ++expired;
     }
+
+    sessionsSharedData->authTokensStats.expired += expired;
+
+    if(expired)
+        Log()->debug("{} auth tokens expired. {} auth tokens left", expired, authTokens.size());
 }
 
 void ScheduleAuthTokensCleanup(Session::SharedData* sessionsSharedData) {
@@ -112,9 +135,10 @@ void ScheduleAuthTokensCleanup(Session::SharedData* sessionsSharedData) {
     g_source_set_callback(
         timeoutSource,
         [] (gpointer userData) -> gboolean {
+            DispatchScope dispatchScope("auth_tokens_cleanup");
             Session::SharedData* sessionsSharedData = reinterpret_cast<Session::SharedData*>(userData);
             CleanupAuthTokens(sessionsSharedData);
-            return false;
+            return true;
         },
         sessionsSharedData,
         nullptr);
@@ -122,43 +146,170 @@ void ScheduleAuthTokensCleanup(Session::SharedData* sessionsSharedData) {
     g_source_attach(timeoutSource, threadContext ? threadContext : g_main_context_default());
 }
 
+void CleanupFilePlayerMounts(Session::SharedData* sessionsSharedData)
+{
+    const auto now = std::chrono::steady_clock::now();
+
+    auto& mounts = sessionsSharedData->filePlayerMounts;
+    for(auto it = mounts.begin(); it != mounts.end();) {
+        const MountPointState& state = *it->second.state;
+        if(state.peers == 0 && now - state.idleSince >= FilePlayerIdleLinger) {
+            Log()->debug("Destroying idle file player mount for \"{}\"", it->first);
+            it = mounts.erase(it);
+        } else
+            ++it;
+    }
+}
+
+void CleanupLazyMounts(const Config* config, Session::SharedData* sessionsSharedData)
+{
+    const auto now = std::chrono::steady_clock::now();
+
+    auto& mounts = sessionsSharedData->lazyMounts;
+    for(auto it = mounts.begin(); it != mounts.end();) {
+        const MountPointState& state = *it->second.state;
+        if(state.peers == 0 && now - state.idleSince >= config->lazyMountsIdleTimeout) {
+            Log()->info("Destroying idle mount for \"{}\"", it->first);
+            it = mounts.erase(it);
+            ++sessionsSharedData->lazyMountsStats.destroyed;
+        } else
+            ++it;
+    }
+}
+
+void CleanupRetiredMounts(Session::SharedData* sessionsSharedData)
+{
+    auto& retiredMounts = sessionsSharedData->retiredMounts;
+    for(auto it = retiredMounts.begin(); it != retiredMounts.end();) {
+        if(it->state->peers == 0) {
+            Log()->debug("Destroying retired mount");
+            it = retiredMounts.erase(it);
+        } else
+            ++it;
+    }
+}
+
+void ScheduleMountsCleanup(const Config* config, Session::SharedData* sessionsSharedData) {
+    GSourcePtr timeoutSourcePtr(g_timeout_source_new_seconds(MountsCleanupInterval));
+    GSource* timeoutSource = timeoutSourcePtr.get();
+
+    struct CallbackData {
+        const Config *const config;
+        Session::SharedData *const sessionsSharedData;
+    };
+
+    g_source_set_callback(
+        timeoutSource,
+        [] (gpointer userData) -> gboolean {
+            DispatchScope dispatchScope("mounts_cleanup");
+            const CallbackData* callbackData = reinterpret_cast<CallbackData*>(userData);
+            CleanupFilePlayerMounts(callbackData->sessionsSharedData);
+            CleanupLazyMounts(callbackData->config, callbackData->sessionsSharedData);
+            CleanupRetiredMounts(callbackData->sessionsSharedData);
+            return true;
+        },
+        new CallbackData { config, sessionsSharedData },
+        [] (gpointer userData) {
+            delete reinterpret_cast<CallbackData*>(userData);
+        });
+    GMainContext* threadContext = g_main_context_get_thread_default();
+    g_source_attach(timeoutSource, threadContext ? threadContext : g_main_context_default());
+}
+
+// measures how late main loop dispatches timer
+void ScheduleMainLoopLatencyProbe(Session::SharedData* sessionsSharedData) {
+    GSourcePtr timeoutSourcePtr(g_timeout_source_new(MainLoopProbeInterval));
+    GSource* timeoutSource = timeoutSourcePtr.get();
+
+    struct CallbackData {
+        Session::SharedData *const sessionsSharedData;
+        gint64 expectedAt; // monotonic time, microseconds
+    };
+
+    g_source_set_callback(
+        timeoutSource,
+        [] (gpointer userData) -> gboolean {
+            CallbackData* callbackData = reinterpret_cast<CallbackData*>(userData);
+
+            const gint64 now = g_get_monotonic_time();
+            const std::chrono::microseconds latency(std::max<gint64>(now - callbackData->expectedAt, 0));
+            callbackData->expectedAt = now + MainLoopProbeInterval * 1000;
+
+            MainLoopStats& stats = callbackData->sessionsSharedData->mainLoopStats;
+            stats.lastLatency = latency;
+            stats.latencySum += latency;
+            ++stats.probes;
+
+            return true;
+        },
+        new CallbackData { sessionsSharedData, g_get_monotonic_time() + MainLoopProbeInterval * 1000 },
+        [] (gpointer userData) {
+            delete reinterpret_cast<CallbackData*>(userData);
+        });
+    GMainContext* threadContext = g_main_context_get_thread_default();
+    g_source_attach(timeoutSource, threadContext ? threadContext : g_main_context_default());
+}
+
+struct RecordingFileData {
+    guint64 size;
+    gint64 modificationTime; // microseconds since epoch
+};
+
+struct RecordingsCleanupContext;
+
 struct RecordingsMonitorContext {
-    RecordingsMonitorContext(const RecordConfig& config, GFilePtr&& dirPtr, GFileMonitorPtr&& monitor) :
-        config(config), dirPtr(std::move(dirPtr)), monitorPtr(std::move(monitor)) {}
+    RecordingsMonitorContext(
+        RecordingsCleanupContext *const cleanupContext,
+        const RecordConfig& config,
+        GFilePtr&& dirPtr,
+        GFileMonitorPtr&& monitor) :
+        cleanupContext(cleanupContext),
+        config(config),
+        dirPtr(std::move(dirPtr)),
+        monitorPtr(std::move(monitor)) {}
 
+    RecordingsCleanupContext *const cleanupContext;
     const RecordConfig config;
     GFilePtr dirPtr;
     GFileMonitorPtr monitorPtr;
+
+    std::map<std::string, RecordingFileData> files; // file name -> file data
+    std::set<std::pair<gint64, std::string>> filesByTime; // (modification time, file name)
+    guint64 dirSize = 0;
 };
 
 struct FilesMonitorsContext;
 
+struct FileListEntry {
+    uint64_t timestamp;
+    std::string line; // formatted list line for the file
+};
+
 struct FilesMonitorContext {
     FilesMonitorContext(
-        const FilesMonitorsContext *const monitorsContext,
+        FilesMonitorsContext *const monitorsContext,
         const std::string& streamer,
+        std::chrono::milliseconds listUpdateDelay,
         GFilePtr&& dirPtr,
         GFileMonitorPtr&& monitor) :
         monitorsContext(monitorsContext),
         streamer(streamer),
+        listUpdateDelay(listUpdateDelay),
         dirPtr(std::move(dirPtr)),
         monitorPtr(std::move(monitor)) {}
 
-    const FilesMonitorsContext *const monitorsContext;
+    FilesMonitorsContext *const monitorsContext;
     const std::string streamer;
+    std::chrono::milliseconds listUpdateDelay; // can be changed on reload
     GFilePtr dirPtr;
     GFileMonitorPtr monitorPtr;
-    std::map<std::string, uint64_t> files; // file name -> file timestamp
-};
-
-struct GDateTimeLess {
-    bool operator() (const GDateTimePtr& l, const GDateTimePtr& r) const {
-        return g_date_time_compare(l.get(), r.get()) < 0;
-    }
+    std::map<std::string, FileListEntry> files; // file name -> list entry
+    GSourcePtr listUpdateSourcePtr;
 };
 
 struct RecordingsCleanupContext {
-    std::deque<RecordingsMonitorContext> monitors;
+    std::list<RecordingsMonitorContext> monitors;
+    std::atomic<guint64> recordingsSize = 0; // all dirs, read from main thread
 };
 
 struct FilesMonitorsContext {
@@ -167,84 +318,127 @@ struct FilesMonitorsContext {
 
     const GMainContextPtr mainContextPtr;
     Session::SharedData *const sharedData;
-    std::deque<FilesMonitorContext> monitors;
+    std::list<FilesMonitorContext> monitors;
+    // shared by all monitors to let main loop drop lists posted by removed monitors
+    uint64_t listVersion = 0;
 };
 
-struct FileData {
-    GFilePtr filePtr;
-    guint64 fileSize;
+struct BackgroundMonitors {
+    std::unique_ptr<RecordingsCleanupContext> recordingsCleanupContext;
+    std::unique_ptr<Actor> recordingsCleanupActor;
+    std::unique_ptr<FilesMonitorsContext> filesMonitorsContext;
+    std::unique_ptr<Actor> filesMonitorsActor;
 };
 
+void IndexRecording(
+    RecordingsMonitorContext& monitorContext,
+    const std::string& fileName,
+    GFileInfo* fileInfo)
+{
+    g_autoptr(GDateTime) fileTime = g_file_info_get_modification_date_time(fileInfo);
+    if(!fileTime)
+        return;
+
+    const RecordingFileData fileData {
+        g_file_info_get_size(fileInfo),
+        g_date_time_to_unix(fileTime) * G_USEC_PER_SEC + g_date_time_get_microsecond(fileTime) };
+
+    std::atomic<guint64>& recordingsSize = monitorContext.cleanupContext->recordingsSize;
+
+    auto [it, inserted] = monitorContext.files.emplace(fileName, fileData);
+    if(!inserted) {
+        monitorContext.dirSize -= it->second.size;
+        recordingsSize -= it->second.size;
+        monitorContext.filesByTime.erase({ it->second.modificationTime, fileName });
+        it->second = fileData;
+    }
+
+    monitorContext.dirSize += fileData.size;
+    recordingsSize += fileData.size;
+    monitorContext.filesByTime.emplace(fileData.modificationTime, fileName);
+}
+
+void UnindexRecording(
+    RecordingsMonitorContext& monitorContext,
+    const std::string& fileName)
+{
+    auto it = monitorContext.files.find(fileName);
+    if(it == monitorContext.files.end())
+        return;
+
+    monitorContext.dirSize -= it->second.size;
+    monitorContext.cleanupContext->recordingsSize -= it->second.size;
+    monitorContext.filesByTime.erase({ it->second.modificationTime, fileName });
+    monitorContext.files.erase(it);
+}
+
+// deletes not more than MAX_FILES_TO_CLEANUP per call to not block thread for long,
+// the rest is deleted on next events
+void CleanupRecordings(RecordingsMonitorContext& monitorContext)
+{
+    for(
+        unsigned deleted = 0;
+        deleted < MAX_FILES_TO_CLEANUP &&
+            monitorContext.dirSize > monitorContext.config.maxDirSize &&
+            !monitorContext.filesByTime.empty();
+        ++deleted)
+    {
+        const std::string fileName = monitorContext.filesByTime.begin()->second;
+
+        GFilePtr filePtr(g_file_get_child(monitorContext.dirPtr.get(), fileName.c_str()));
+        g_autoptr(GError) error = nullptr;
+        if(!g_file_delete(filePtr.get(), nullptr, &error))
+            Log()->error("Failed to delete recording \"{}\": {}", fileName, error->message);
+
+        // drop it from index anyway to not stuck on undeletable file
+        UnindexRecording(monitorContext, fileName);
+    }
+}
+
 void RecordingsDirChanged(
     GFileMonitor* monitor,
-    GFile* /*file*/,
+    GFile* file,
     GFile* /*otherFile*/,
     GFileMonitorEvent eventType,
     gpointer userData)
 {
     RecordingsMonitorContext& monitorContext = *static_cast<RecordingsMonitorContext*>(userData);
 
-    if(eventType != G_FILE_MONITOR_EVENT_CREATED && eventType != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
-        return;
-
-    std::map<GDateTimePtr, FileData, GDateTimeLess> candidatesToDelete;
-    guint64 dirSize = 0;
+    switch(eventType) {
+        // file being written grows after CREATED,
+        // so it's reindexed on (rate limited) CHANGED and on CHANGES_DONE_HINT when it's closed
+        case G_FILE_MONITOR_EVENT_CREATED:
+        case G_FILE_MONITOR_EVENT_CHANGED:
+        case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT: {
+            g_autofree gchar* fileName = g_file_get_basename(file);
+            g_autoptr(GFileInfo) fileInfo =
+                g_file_query_info(
+                    file,
+                    G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                    G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                    G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                    G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                    nullptr,
+                    nullptr);
+            if(!fileName || !fileInfo || g_file_info_get_file_type(fileInfo) != G_FILE_TYPE_REGULAR)
+                break;
 
-    g_autoptr(GFileEnumerator) enumerator(
-        g_file_enumerate_children(
-            monitorContext.dirPtr.get(),
-            G_FILE_ATTRIBUTE_STANDARD_SIZE "," G_FILE_ATTRIBUTE_TIME_MODIFIED,
-            G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
-            nullptr,
-            nullptr));
-
-    if(enumerator) {
-        GFileInfo* childInfo;
-        GFile* child;
-        for(
-            gboolean iterated = g_file_enumerator_iterate(enumerator, &childInfo, &child, nullptr, nullptr);
-            iterated && childInfo && child;
-            iterated = g_file_enumerator_iterate(enumerator, &childInfo, &child, nullptr, nullptr))
-        {
-            switch(g_file_info_get_file_type(childInfo)) {
-                case G_FILE_TYPE_REGULAR: {
-                    const guint64 fileSize = g_file_info_get_size(childInfo);
-                    dirSize += fileSize;
-
-                    if(g_autoptr(GDateTime) fileTime = g_file_info_get_modification_date_time(childInfo)) {
-                        if(candidatesToDelete.size() < MAX_FILES_TO_CLEANUP ||
-                            g_date_time_compare((--candidatesToDelete.end())->first.get(), fileTime) > 0)
-                        {
-                            candidatesToDelete.emplace(
-                                g_date_time_ref(fileTime),
-                                FileData {
-                                    GFilePtr(G_FILE(g_object_ref(child))),
-                                    fileSize });
-                        }
-                        if(candidatesToDelete.size() > MAX_FILES_TO_CLEANUP) {
-                            candidatesToDelete.erase(--candidatesToDelete.end());
-                        }
-                    }
-                    break;
-                }
-                default:
-                    break;
-            }
+            IndexRecording(monitorContext, fileName, fileInfo);
+            CleanupRecordings(monitorContext);
+            break;
         }
-    }
-
-    if(candidatesToDelete.empty())
-        return;
-
-    auto it = candidatesToDelete.begin();
-    while(it != candidatesToDelete.end() && dirSize > monitorContext.config.maxDirSize) {
-        dirSize -= it->second.fileSize;
-        g_file_delete(it->second.filePtr.get(), nullptr, nullptr);
-        ++it;
+        case G_FILE_MONITOR_EVENT_DELETED: {
+            g_autofree gchar* fileName = g_file_get_basename(file);
+            if(fileName)
+                UnindexRecording(monitorContext, fileName);
+            break;
+        }
+        default:
+            break;
     }
 }
 
-void RecordingsCleanupInitAction(
+void AddRecordingsMonitorsAction(
     RecordingsCleanupContext& context,
     const std::deque<RecordConfig>& cleanupList)
 {
@@ -260,6 +454,7 @@ void RecordingsCleanupInitAction(
             g_file_monitor_set_rate_limit(dirMonitorPtr.get(), 5000);
             RecordingsMonitorContext& monitorContext =
                 context.monitors.emplace_back(
+                    &context,
                     config,
                     std::move(monitorDirPtr),
                     std::move(dirMonitorPtr));
@@ -268,10 +463,85 @@ void RecordingsCleanupInitAction(
                 "changed",
                 G_CALLBACK(RecordingsDirChanged),
                 &monitorContext);
+
+            g_autoptr(GFileEnumerator) enumerator(
+                g_file_enumerate_children(
+                    monitorContext.dirPtr.get(),
+                    G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                    G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+                    G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                    G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                    G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                    nullptr,
+                    nullptr));
+
+            if(enumerator) {
+                GFileInfo* childInfo;
+                GFile* child;
+                for(
+                    gboolean iterated = g_file_enumerator_iterate(enumerator, &childInfo, &child, nullptr, nullptr);
+                    iterated && childInfo && child;
+                    iterated = g_file_enumerator_iterate(enumerator, &childInfo, &child, nullptr, nullptr))
+                {
+                    if(g_file_info_get_file_type(childInfo) == G_FILE_TYPE_REGULAR)
+                        IndexRecording(monitorContext, g_file_info_get_name(childInfo), childInfo);
+                }
+            }
+
+            Log()->debug(
+                "{} recordings in \"{}\" take {} bytes",
+                monitorContext.files.size(),
+                config.dir.string(),
+                monitorContext.dirSize);
+
+            CleanupRecordings(monitorContext);
         }
     }
 }
 
+void RemoveRecordingsMonitorsAction(
+    RecordingsCleanupContext& context,
+    const std::deque<RecordConfig>& removeList)
+{
+    for(const RecordConfig& config: removeList) {
+        for(auto it = context.monitors.begin(); it != context.monitors.end();) {
+            if(it->config.dir == config.dir) {
+                g_file_monitor_cancel(it->monitorPtr.get());
+                context.recordingsSize -= it->dirSize;
+                it = context.monitors.erase(it);
+            } else
+                ++it;
+        }
+    }
+}
+
+void AddFileListEntry(
+    FilesMonitorContext* monitorContext,
+    const std::string& fileName,
+    uint64_t timestamp)
+{
+    auto [it, inserted] = monitorContext->files.try_emplace(fileName);
+    FileListEntry& entry = it->second;
+    if(!inserted && entry.timestamp == timestamp)
+        return;
+
+    entry.timestamp = timestamp;
+
+    std::string& line = entry.line;
+    line = fileName;
+    line += ": ";
+
+    GDateTimePtr timePtr(g_date_time_new_from_unix_utc(timestamp));
+    GCharPtr isoTime(timePtr ? g_date_time_format_iso8601(timePtr.get()) : nullptr);
+    if(isoTime) {
+        line += isoTime.get();
+    } else {
+        line += std::to_string(timestamp);
+    }
+
+    line += "\r\n";
+}
+
 void PostDirContent(
     GMainContext* mainContext,
     Session::SharedData* sharedData,
@@ -283,41 +553,48 @@ void PostDirContent(
     struct CallbackData {
         const std::string streamer;
         Session::SharedData *const sharedData;
-        const std::string list;
+        const MountpointListCache listCache;
     };
 
-    std::string list;
-    for(const auto& pair: monitorContext->files) {
-        list += pair.first;
-        list += ": ";
-
-        GDateTimePtr timePtr(g_date_time_new_from_unix_utc(pair.second));
-        GCharPtr isoTime(timePtr ? g_date_time_format_iso8601(timePtr.get()) : nullptr);
-        if(isoTime) {
-            list += isoTime.get();
-        } else {
-            list += std::to_string(pair.second);
-        }
+    std::string::size_type listSize = 0;
+    for(const auto& pair: monitorContext->files)
+        listSize += pair.second.line.size();
 
-        list += "\r\n";
-    }
+    // file names are prefixed with streamer name
+    const std::string::size_type nameOffset = monitorContext->streamer.size() + 1;
+
+    MountpointListCacheBuilder listBuilder;
+    listBuilder.reserve(listSize, monitorContext->files.size());
+    for(const auto& pair: monitorContext->files)
+        listBuilder.add(pair.second.line, nameOffset, pair.second.timestamp);
 
     CallbackData* callbackData = new CallbackData {
         monitorContext->streamer,
         sharedData,
-        std::move(list) };
+        listBuilder.build(++monitorContext->monitorsContext->listVersion) };
     g_source_set_callback(
         idleSource,
         [] (gpointer userData) -> gboolean {
+            DispatchScope dispatchScope("files_list_update");
             const CallbackData* callbackData = reinterpret_cast<CallbackData*>(userData);
 
             const std::string& streamer = callbackData->streamer;
-            const std::string& list = callbackData->list;
+            const MountpointListCache& listCache = callbackData->listCache;
+            Session::SharedData* sharedData = callbackData->sharedData;
+
+            // streamer could be removed or replaced on config reload
+            const StreamerRoute* route = sharedData->routes.find(streamer);
+            if(!route || route->type != StreamerConfig::Type::FilePlayer)
+                return false;
+
+            MountpointListCache& cachedList = sharedData->mountpointsListsCache[streamer];
+            if(cachedList.version >= listCache.version)
+                return false;
 
             Log()->debug("Dir content changed for \"{}\"", streamer);
-            Log()->trace(list);
+            Log()->trace(*listCache.list);
 
-            callbackData->sharedData->mountpointsListsCache[streamer] = list;
+            cachedList = listCache;
 
             return false;
         },
@@ -328,6 +605,30 @@ void PostDirContent(
     g_source_attach(idleSource, mainContext);
 }
 
+// coalesces dir changes happened during FilesMonitorContext::listUpdateDelay
+void SchedulePostDirContent(FilesMonitorContext* monitorContext)
+{
+    if(monitorContext->listUpdateSourcePtr)
+        return;
+
+    monitorContext->listUpdateSourcePtr.reset(g_timeout_source_new(monitorContext->listUpdateDelay.count()));
+    GSource* timeoutSource = monitorContext->listUpdateSourcePtr.get();
+    g_source_set_callback(
+        timeoutSource,
+        [] (gpointer userData) -> gboolean {
+            FilesMonitorContext* monitorContext = reinterpret_cast<FilesMonitorContext*>(userData);
+            const FilesMonitorsContext& monitorsContext = *monitorContext->monitorsContext;
+
+            monitorContext->listUpdateSourcePtr.reset();
+            PostDirContent(monitorsContext.mainContextPtr.get(), monitorsContext.sharedData, monitorContext);
+
+            return false;
+        },
+        monitorContext,
+        nullptr);
+    g_source_attach(timeoutSource, g_main_context_get_thread_default());
+}
+
 void FilesDirChanged(
     GFileMonitor* monitor,
     GFile* file,
@@ -336,7 +637,6 @@ void FilesDirChanged(
     gpointer userData)
 {
     FilesMonitorContext& context = *static_cast<FilesMonitorContext*>(userData);
-    const FilesMonitorsContext& monitorsContext = *context.monitorsContext;
 
     switch(eventType) {
         case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT: {
@@ -356,12 +656,12 @@ void FilesDirChanged(
             g_autoptr(GDateTime) fileTime = g_file_info_get_creation_date_time(fileInfo);
             if(fileName && fileTime) {
                 g_autofree gchar* escapedFileName(g_uri_escape_string(fileName, nullptr, false));
-                context.files.emplace(
+                AddFileListEntry(
+                    &context,
                     escapedStreamerName + rtsp::UriSeparator + escapedFileName,
                     g_date_time_to_unix(fileTime));
 
-                // FIXME! protect from too frequent changes
-                PostDirContent(monitorsContext.mainContextPtr.get(), monitorsContext.sharedData, &context);
+                SchedulePostDirContent(&context);
             } else {
                 assert(false); // FIXME?
             }
@@ -373,10 +673,8 @@ void FilesDirChanged(
                 const std::string& escapedStreamerName = context.streamer;
                 g_autofree gchar* escapedFileName(g_uri_escape_string(fileName, nullptr, false));
 
-                context.files.erase(escapedStreamerName + rtsp::UriSeparator + escapedFileName);
-
-                // FIXME! protect from too frequent changes
-                PostDirContent(monitorsContext.mainContextPtr.get(), monitorsContext.sharedData, &context);
+                if(context.files.erase(escapedStreamerName + rtsp::UriSeparator + escapedFileName))
+                    SchedulePostDirContent(&context);
             } else {
                 assert(false); // FIXME?
             }
@@ -387,14 +685,15 @@ void FilesDirChanged(
     }
 }
 
-void FilesMonitorsInitAction(
+void AddFilesMonitorsAction(
     FilesMonitorsContext& context,
-    const std::deque<std::pair<std::string, std::string>>& monitorList)
+    const std::deque<std::pair<std::string, StreamerConfig>>& monitorList)
 {
-    for(const std::pair<std::string, std::string>& pair: monitorList) {
+    for(const std::pair<std::string, StreamerConfig>& pair: monitorList) {
         const std::string& escapedStreamerName = pair.first;
+        const StreamerConfig& streamerConfig = pair.second;
 
-        GFilePtr monitorDirPtr(g_file_new_for_path(pair.second.c_str()));
+        GFilePtr monitorDirPtr(g_file_new_for_path(streamerConfig.uri.c_str()));
         GFileMonitorPtr dirMonitorPtr(
             g_file_monitor_directory(
                 monitorDirPtr.get(),
@@ -407,6 +706,7 @@ void FilesMonitorsInitAction(
                 context.monitors.emplace_back(
                     &context,
                     pair.first,
+                    streamerConfig.filesListUpdateDelay,
                     GFilePtr(g_object_ref(monitorDirPtr.get())),
                     std::move(dirMonitorPtr));
             g_signal_connect(
@@ -437,7 +737,8 @@ void FilesMonitorsInitAction(
                             g_autoptr(GDateTime) fileTime = g_file_info_get_creation_date_time(childInfo);
                             if(fileName && fileTime) {
                                 GCharPtr escapedFileNamePtr(g_uri_escape_string(fileName, nullptr, false));
-                                monitorContext.files.emplace(
+                                AddFileListEntry(
+                                    &monitorContext,
                                     escapedStreamerName + rtsp::UriSeparator + escapedFileNamePtr.get(),
                                     g_date_time_to_unix(fileTime));
                             }
@@ -454,25 +755,311 @@ void FilesMonitorsInitAction(
     }
 }
 
+void RemoveFilesMonitorsAction(
+    FilesMonitorsContext& context,
+    const std::set<std::string>& removeList)
+{
+    for(auto it = context.monitors.begin(); it != context.monitors.end();) {
+        if(removeList.count(it->streamer)) {
+            g_file_monitor_cancel(it->monitorPtr.get());
+            if(it->listUpdateSourcePtr)
+                g_source_destroy(it->listUpdateSourcePtr.get());
+            it = context.monitors.erase(it);
+        } else
+            ++it;
+    }
 }
 
-typedef std::map<std::string, std::unique_ptr<GstStreamingSource>> MountPoints;
+// new delay is used starting from the next dir change
+void UpdateFilesMonitorsAction(
+    FilesMonitorsContext& context,
+    const std::map<std::string, std::chrono::milliseconds>& updateList)
+{
+    for(FilesMonitorContext& monitorContext: context.monitors) {
+        auto it = updateList.find(monitorContext.streamer);
+        if(it != updateList.end())
+            monitorContext.listUpdateDelay = it->second;
+    }
+}
+
+void StartRecordingsCleanup(
+    BackgroundMonitors* monitors,
+    const std::deque<RecordConfig>& cleanupList)
+{
+    if(cleanupList.empty())
+        return;
+
+    if(!monitors->recordingsCleanupActor) {
+        monitors->recordingsCleanupContext = std::make_unique<RecordingsCleanupContext>();
+        monitors->recordingsCleanupActor = std::make_unique<Actor>();
+    }
+
+    monitors->recordingsCleanupActor->postAction(
+        std::bind(
+            AddRecordingsMonitorsAction,
+            std::ref(*monitors->recordingsCleanupContext),
+            cleanupList));
+}
+
+void StartFilesMonitors(
+    BackgroundMonitors* monitors,
+    GMainContext* mainContext,
+    Session::SharedData* sharedData,
+    const std::deque<std::pair<std::string, StreamerConfig>>& monitorList)
+{
+    if(monitorList.empty())
+        return;
+
+    if(!monitors->filesMonitorsActor) {
+        monitors->filesMonitorsContext =
+            std::make_unique<FilesMonitorsContext>(
+                GMainContextPtr(g_main_context_ref(mainContext)),
+                sharedData);
+        monitors->filesMonitorsActor = std::make_unique<Actor>();
+    }
+
+    monitors->filesMonitorsActor->postAction(
+        std::bind(
+            AddFilesMonitorsAction,
+            std::ref(*monitors->filesMonitorsContext),
+            monitorList));
+}
+
+}
+
+// callbacks of retired recorder are ignored,
+// since streamer with the same name can be added again
+static void OnRecorderConnected(
+    Session::SharedData* sharedData,
+    const std::string& uri,
+    const MountPointStatePtr& state)
+{
+    if(state->retired)
+        return;
+
+    Log()->info("Recorder connected to \"{}\" streamer", uri);
+
+    Session::RecordMountpointData& data = sharedData->recordMountpointsData[uri];
+
+    data.recording = true;
+
+    std::unordered_map<Session*, rtsp::MediaSessionId> subscriptions;
+    data.subscriptions.swap(subscriptions);
+
+    const StreamerRoute* route = sharedData->routes.find(uri);
+    if(!route)
+        return;
+
+    for(auto& session2session: subscriptions) {
+        Session* session = session2session.first;
+        const rtsp::MediaSessionId& mediaSession = session2session.second;
+        session->startRecordToSubscriber(*route, uri, mediaSession);
+    }
+}
+
+static void OnRecorderDisconnected(
+    Session::SharedData* sharedData,
+    const std::string& uri,
+    const MountPointStatePtr& state)
+{
+    if(state->retired)
+        return;
+
+    Log()->info("Recorder disconnected from \"{}\" streamer", uri);
+
+    auto it = sharedData->recordMountpointsData.find(uri);
+    if(it == sharedData->recordMountpointsData.end()) {
+        return;
+    }
+
+    Session::RecordMountpointData& data = it->second;
+    data.recording = false;
+    assert(data.subscriptions.empty());
+}
+
+static std::unique_ptr<GstStreamingSource> CreateMountPoint(
+    Session::SharedData* sharedData,
+    const std::string& name,
+    const StreamerConfig& streamerConfig,
+    const MountPointStatePtr& state)
+{
+    switch(streamerConfig.type) {
+    case StreamerConfig::Type::Test:
+        return std::make_unique<GstTestStreamer2>(streamerConfig.uri);
+    case StreamerConfig::Type::ReStreamer:
+        return
+            std::make_unique<GstReStreamer2>(
+                streamerConfig.uri,
+                streamerConfig.forceH264ProfileLevelId);
+#if ONVIF_SUPPORT
+    case StreamerConfig::Type::ONVIFReStreamer:
+        return
+            std::make_unique<ONVIFReStreamer>(
+                streamerConfig.uri,
+                streamerConfig.forceH264ProfileLevelId,
+                streamerConfig.username,
+                streamerConfig.password);
+#endif
+    case StreamerConfig::Type::Record:
+        typedef GstRecordStreamer::RecordOptions RecordOptions;
+        return
+            std::make_unique<GstRecordStreamer>(
+                streamerConfig.recordConfig ?
+                    std::optional<RecordOptions>({
+                        streamerConfig.recordConfig->dir,
+                        streamerConfig.recordConfig->maxFileSize}) :
+                    std::optional<RecordOptions>(),
+                std::bind(OnRecorderConnected, sharedData, name, state),
+                std::bind(OnRecorderDisconnected, sharedData, name, state));
+    case StreamerConfig::Type::Pipeline:
+        return std::make_unique<GstPipelineStreamer2>(streamerConfig.pipeline);
+    case StreamerConfig::Type::Camera: {
+        const std::optional<CameraConfig>& cameraConfig = streamerConfig.cameraConfig;
+        std::optional<GstCameraStreamer::VideoResolution> resolution;
+        std::optional<unsigned> framerate;
+        if(cameraConfig) {
+            if(cameraConfig->resolution) {
+                resolution = GstCameraStreamer::VideoResolution {
+                    cameraConfig->resolution->width,
+                    cameraConfig->resolution->height };
+            }
+            framerate = cameraConfig->framerate;
+        }
+        return
+            std::make_unique<GstCameraStreamer>(
+                resolution,
+                framerate,
+                std::optional<std::string>(),
+                streamerConfig.useHwEncoder);
+    }
+    case StreamerConfig::Type::V4L2:
+        return
+            std::make_unique<GstV4L2ReStreamer>(
+                streamerConfig.edidFilePath,
+                std::optional<GstV4L2ReStreamer::VideoResolution>(),
+                std::optional<std::string>(),
+                streamerConfig.useHwEncoder);
+    default:
+        return nullptr;
+    }
+}
+
+// mount point created at startup or on reload
+struct MountPointData {
+    std::unique_ptr<GstStreamingSource> streamer;
+    MountPointStatePtr state;
+};
+typedef std::map<std::string, MountPointData> MountPoints;
 
 static std::unique_ptr<WebRTCPeer>
-CreatePeer(
-    const Config* config,
-    MountPoints* mountPoints,
-    const std::string& uri)
+CreateFilePlayerPeer(
+    const StreamerConfig& streamerConfig,
+    Session::SharedData* sharedData,
+    const std::string& filePath,
+    const std::string& fileUri,
+    PeerLease* lease)
 {
-    const auto& [streamerName, substreamName] = rtsp::SplitUri(uri);
+    if(streamerConfig.filePlayerJoinWindow == std::chrono::seconds::zero())
+        return std::make_unique<GstReStreamer>(fileUri, streamerConfig.forceH264ProfileLevelId);
 
-    auto configStreamerIt = config->streamers.find(streamerName);
-    if(configStreamerIt == config->streamers.end() || !configStreamerIt->second.restream)
+    auto& mounts = sharedData->filePlayerMounts;
+    const auto now = std::chrono::steady_clock::now();
+
+    // the most recently started mount for the file is the last one in range
+    auto [beginIt, mountIt] = mounts.equal_range(filePath);
+    if(beginIt != mountIt && now - std::prev(mountIt)->second.startedAt < streamerConfig.filePlayerJoinWindow) {
+        --mountIt;
+        Log()->debug("Joining file player mount for \"{}\"", filePath);
+    } else {
+        mountIt = mounts.emplace_hint(
+            mountIt,
+            filePath,
+            OnDemandMountData {
+                std::make_shared<GstReStreamer2>(fileUri, streamerConfig.forceH264ProfileLevelId),
+                now });
+        Log()->debug("New file player mount for \"{}\"", filePath);
+    }
+
+    OnDemandMountData& mount = mountIt->second;
+    std::unique_ptr<WebRTCPeer> peerPtr = mount.streamer->createPeer();
+    if(peerPtr)
+        lease->mountPoint = mount.state;
+
+    return peerPtr;
+}
+
+static std::unique_ptr<WebRTCPeer>
+CreateLazyMountPeer(
+    Session::SharedData* sharedData,
+    const StreamerRoute& route,
+    PeerLease* lease)
+{
+    auto& mounts = sharedData->lazyMounts;
+
+    auto mountIt = mounts.find(route.name);
+    if(mountIt != mounts.end()) {
+        OnDemandMountData& mount = mountIt->second;
+        std::unique_ptr<WebRTCPeer> peerPtr = mount.streamer->createPeer();
+        if(peerPtr)
+            lease->mountPoint = mount.state;
+        return peerPtr;
+    }
+
+    const auto startedAt = std::chrono::steady_clock::now();
+
+    const std::string name(route.name);
+    MountPointStatePtr state = std::make_shared<MountPointState>();
+    std::unique_ptr<GstStreamingSource> mountPoint = CreateMountPoint(sharedData, name, *route.config, state);
+    if(!mountPoint)
         return nullptr;
 
-    const StreamerConfig& streamerConfig = configStreamerIt->second;
-    if(configStreamerIt->second.type == StreamerConfig::Type::FilePlayer) {
-        g_autofree gchar* unEscapedSubstreamName = g_uri_unescape_string(substreamName.c_str(), nullptr);
+    std::unique_ptr<WebRTCPeer> peerPtr = mountPoint->createPeer();
+    if(!peerPtr) {
+        Log()->error("Failed to create peer for \"{}\". Mount is not kept", name);
+        return nullptr;
+    }
+
+    OnDemandMountData& mount =
+        mounts.emplace(name, OnDemandMountData { std::move(mountPoint), startedAt, std::move(state) }).first->second;
+    lease->mountPoint = mount.state;
+
+    const auto instantiationTime =
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startedAt);
+    LazyMountsStats& stats = sharedData->lazyMountsStats;
+    ++stats.instantiated;
+    stats.lastInstantiationTime = instantiationTime;
+    stats.maxInstantiationTime = std::max(stats.maxInstantiationTime, instantiationTime);
+
+    Log()->info(
+        "Mount for \"{}\" instantiated in {} us ({} instantiated, {} destroyed so far)",
+        name,
+        instantiationTime.count(),
+        stats.instantiated,
+        stats.destroyed);
+
+    return peerPtr;
+}
+
+static std::unique_ptr<WebRTCPeer>
+CreateStreamerPeer(
+    Session::SharedData* sharedData,
+    const StreamerRoute& route,
+    const std::string& uri,
+    PeerLease* lease)
+{
+    if(!route.restream)
+        return nullptr;
+
+    if(route.type == StreamerConfig::Type::FilePlayer) {
+        std::string_view substreamName;
+        StreamerRoutes::SplitUri(uri, &substreamName);
+
+        const StreamerConfig& streamerConfig = *route.config;
+        g_autofree gchar* unEscapedSubstreamName =
+            g_uri_unescape_segment(
+                substreamName.data(),
+                substreamName.data() + substreamName.size(),
+                nullptr);
         g_autofree gchar* reEscapedSubstreamName = g_uri_escape_string(unEscapedSubstreamName, " ()", false);
 
         GCharPtr fullPathPtr(g_build_filename(streamerConfig.uri.c_str(), reEscapedSubstreamName, nullptr));
@@ -488,32 +1075,54 @@ CreatePeer(
             return nullptr;
         }
 
-        return std::make_unique<GstReStreamer>(fileUriPtr.get(), streamerConfig.forceH264ProfileLevelId);
-    } else {
-        auto streamerIt = mountPoints->find(streamerName);
-        if(streamerIt != mountPoints->end()) {
-            return streamerIt->second->createPeer();
-        } else
-            return nullptr;
-    }
+        return CreateFilePlayerPeer(streamerConfig, sharedData, safePathPtr.get(), fileUriPtr.get(), lease);
+    } else if(route.mountPoint) {
+        std::unique_ptr<WebRTCPeer> peerPtr = route.mountPoint->createPeer();
+        if(peerPtr)
+            lease->mountPoint = route.mountPointState;
+        return peerPtr;
+    } else if(route.lazy) {
+        return CreateLazyMountPeer(sharedData, route, lease);
+    } else
+        return nullptr;
 }
 
 static std::unique_ptr<WebRTCPeer>
-CreateRecordPeer(
-    const Config* config,
-    MountPoints* mountPoints,
-    const std::string& uri)
+CreatePeer(
+    Session::SharedData* sharedData,
+    const StreamerRoute& route,
+    const std::string& uri,
+    PeerLease* lease)
+{
+    DispatchScope dispatchScope("create_peer");
+
+    std::unique_ptr<WebRTCPeer> peerPtr = CreateStreamerPeer(sharedData, route, uri, lease);
+    if(!peerPtr)
+        return nullptr;
+
+    const std::string_view streamerName = route.name;
+    auto& peersCreated = sharedData->peersCreated;
+    auto it = peersCreated.find(streamerName);
+    if(it == peersCreated.end())
+        it = peersCreated.emplace(streamerName, 0).first;
+    ++it->second;
+
+    lease->streamerName = streamerName;
+
+    return peerPtr;
+}
+
+static std::unique_ptr<WebRTCPeer>
+CreateRecordPeer(const StreamerRoute& route)
 {
-    auto streamerIt = mountPoints->find(uri);
-    if(streamerIt != mountPoints->end()) {
-        return streamerIt->second->createRecordPeer();
+    if(route.mountPoint) {
+        return route.mountPoint->createRecordPeer();
     } else
         return nullptr;
 }
 
 static std::unique_ptr<rtsp::ServerSession> CreateSession(
     const Config* config,
-    MountPoints* mountPoints,
     Session::SharedData* sharedData,
     const rtsp::Session::SendRequest& sendRequest,
     const rtsp::Session::SendResponse& sendResponse)
@@ -522,8 +1131,8 @@ static std::unique_ptr<rtsp::ServerSession> CreateSession(
         std::make_unique<Session>(
             config,
             sharedData,
-            std::bind(CreatePeer, config, mountPoints, std::placeholders::_1),
-            std::bind(CreateRecordPeer, config, mountPoints, std::placeholders::_1),
+            std::bind(CreatePeer, sharedData, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
+            CreateRecordPeer,
             sendRequest, sendResponse);
 
     return session;
@@ -533,8 +1142,7 @@ namespace {
 
 std::unique_ptr<rtsp::Session> CreateSignallingSession(
     const Config* config,
-    MountPoints* mountPoints,
-    const Session::SharedData* sharedData,
+    Session::SharedData* sharedData,
     const rtsp::Session::SendRequest& sendRequest,
     const rtsp::Session::SendResponse& sendResponse)
 {
@@ -542,7 +1150,7 @@ std::unique_ptr<rtsp::Session> CreateSignallingSession(
         std::make_unique<SignallingClientSession>(
             config,
             sharedData,
-            std::bind(CreatePeer, config, mountPoints, std::placeholders::_1),
+            std::bind(CreatePeer, sharedData, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
             sendRequest, sendResponse);
 }
 
@@ -564,42 +1172,374 @@ void ClientDisconnected(client::WsClient& client)
 
 }
 
-static void OnRecorderConnected(Session::SharedData* sharedData, const std::string& uri)
+static void AddStreamer(
+    const Config* config,
+    Session::SharedData* sharedData,
+    const std::string& name,
+    const StreamerConfig& streamerConfig,
+    MountPoints* mountPoints,
+    std::deque<RecordConfig>* cleanupList,
+    std::deque<std::pair<std::string, StreamerConfig>>* monitorList)
 {
-    Log()->info("Recorder connected to \"{}\" streamer", uri);
+    if((streamerConfig.type != StreamerConfig::Type::Record || !streamerConfig.recordConfig) && !streamerConfig.restream)
+        return;
 
-    Session::RecordMountpointData& data = sharedData->recordMountpointsData[uri];
+    if(streamerConfig.type == StreamerConfig::Type::Record && streamerConfig.recordConfig)
+        cleanupList->push_back(*streamerConfig.recordConfig);
+    else if(streamerConfig.type == StreamerConfig::Type::FilePlayer)
+        monitorList->emplace_back(name, streamerConfig);
 
-    data.recording = true;
+    if(IsLazyStreamer(*config, streamerConfig))
+        return;
 
-    std::unordered_map<rtsp::ServerSession*, rtsp::MediaSessionId> subscriptions;
-    data.subscriptions.swap(subscriptions);
-    for(auto& session2session: subscriptions) {
-        rtsp::ServerSession* session = session2session.first;
-        const rtsp::MediaSessionId& mediaSession = session2session.second;
-        session->startRecordToClient(uri, mediaSession);
-    }
+    MountPointStatePtr state = std::make_shared<MountPointState>();
+    if(std::unique_ptr<GstStreamingSource> mountPoint = CreateMountPoint(sharedData, name, streamerConfig, state))
+        mountPoints->emplace(name, MountPointData { std::move(mountPoint), std::move(state) });
 }
 
-static void OnRecorderDisconnected(Session::SharedData* sharedData, const std::string& uri)
+// peers of existing sessions can still use mount point
+static void RetireMount(
+    Session::SharedData* sharedData,
+    std::shared_ptr<GstStreamingSource>&& streamer,
+    const MountPointStatePtr& state)
 {
-    Log()->info("Recorder disconnected from \"{}\" streamer", uri);
+    state->retired = true;
 
-    auto it = sharedData->recordMountpointsData.find(uri);
-    if(it == sharedData->recordMountpointsData.end()) {
+    if(state->peers)
+        sharedData->retiredMounts.push_back(RetiredMountData { std::move(streamer), state });
+}
+
+// changes of fields mount point or background monitors are built from require streamer recreation,
+// the rest are read from config on use, so can be changed in place
+static bool SameSource(const StreamerConfig& config, const StreamerConfig& otherConfig)
+{
+    return
+        config.type == otherConfig.type &&
+        config.restream == otherConfig.restream &&
+        config.uri == otherConfig.uri &&
+        config.pipeline == otherConfig.pipeline &&
+        config.username == otherConfig.username &&
+        config.password == otherConfig.password &&
+        config.forceH264ProfileLevelId == otherConfig.forceH264ProfileLevelId &&
+        config.recordConfig == otherConfig.recordConfig &&
+        config.edidFilePath == otherConfig.edidFilePath &&
+        config.cameraConfig == otherConfig.cameraConfig &&
+        config.useHwEncoder == otherConfig.useHwEncoder;
+}
+
+// copies everything SameSource doesn't compare
+static void UpdateInPlace(StreamerConfig* config, const StreamerConfig& newConfig)
+{
+    config->visibility = newConfig.visibility;
+    config->remoteAgentToken = newConfig.remoteAgentToken;
+    config->description = newConfig.description;
+    config->filesListUpdateDelay = newConfig.filesListUpdateDelay;
+    config->filePlayerJoinWindow = newConfig.filePlayerJoinWindow;
+    config->maxViewers = newConfig.maxViewers;
+
+    assert(*config == newConfig);
+}
+
+static void ReloadStreamers(
+    const LoadStreamersConfig& loadStreamersConfig,
+    Config* config,
+    MountPoints* mountPoints,
+    Session::SharedData* sharedData,
+    BackgroundMonitors* monitors,
+    GMainContext* mainContext)
+{
+    Log()->info("Reloading streamers...");
+
+    std::map<std::string, StreamerConfig> streamers;
+    if(!loadStreamersConfig(&streamers)) {
+        Log()->error("Failed to reload config. Streamers left unchanged");
         return;
     }
 
-    Session::RecordMountpointData& data = it->second;
-    data.recording = false;
-    assert(data.subscriptions.empty());
+    auto& currentStreamers = config->streamers;
+
+    unsigned removed = 0;
+    unsigned updated = 0;
+    std::deque<RecordConfig> removedRecordings;
+    std::set<std::string> removedFilesMonitors;
+    std::map<std::string, std::chrono::milliseconds> updatedFilesMonitors;
+    for(auto it = currentStreamers.begin(); it != currentStreamers.end();) {
+        const std::string& name = it->first;
+        StreamerConfig& streamerConfig = it->second;
+
+        auto newIt = streamers.find(name);
+        if(newIt != streamers.end() && newIt->second == streamerConfig) {
+            ++it;
+            continue;
+        }
+
+        // viewers and agents of the streamer are kept
+        if(newIt != streamers.end() && SameSource(newIt->second, streamerConfig)) {
+            Log()->info("Updating streamer \"{}\"...", name);
+
+            const StreamerConfig& newStreamerConfig = newIt->second;
+            if(streamerConfig.type == StreamerConfig::Type::FilePlayer &&
+                newStreamerConfig.filesListUpdateDelay != streamerConfig.filesListUpdateDelay)
+            {
+                updatedFilesMonitors.emplace(name, newStreamerConfig.filesListUpdateDelay);
+            }
+
+            UpdateInPlace(&streamerConfig, newStreamerConfig);
+            ++it;
+            ++updated;
+            continue;
+        }
+
+        Log()->info("Removing streamer \"{}\"...", name);
+
+        auto mountPointIt = mountPoints->find(name);
+        if(mountPointIt != mountPoints->end()) {
+            MountPointData& mountPoint = mountPointIt->second;
+            RetireMount(sharedData, std::move(mountPoint.streamer), mountPoint.state);
+            mountPoints->erase(mountPointIt);
+        }
+        auto lazyMountIt = sharedData->lazyMounts.find(name);
+        if(lazyMountIt != sharedData->lazyMounts.end()) {
+            OnDemandMountData& mount = lazyMountIt->second;
+            RetireMount(sharedData, std::move(mount.streamer), mount.state);
+            sharedData->lazyMounts.erase(lazyMountIt);
+        }
+        // recording state belonged to retired recorder
+        auto recordIt = sharedData->recordMountpointsData.find(name);
+        if(recordIt != sharedData->recordMountpointsData.end())
+            recordIt->second.recording = false;
+
+        if(streamerConfig.type == StreamerConfig::Type::Record && streamerConfig.recordConfig)
+            removedRecordings.push_back(*streamerConfig.recordConfig);
+        else if(streamerConfig.type == StreamerConfig::Type::FilePlayer)
+            removedFilesMonitors.insert(name);
+
+        sharedData->mountpointsListsCache.erase(name);
+        sharedData->agentsMountpoints.erase(name);
+        sharedData->peersCreated.erase(name);
+
+        it = currentStreamers.erase(it);
+        ++removed;
+    }
+
+    unsigned added = 0;
+    std::deque<RecordConfig> cleanupList;
+    std::deque<std::pair<std::string, StreamerConfig>> monitorList;
+    for(const auto& [name, streamerConfig]: streamers) {
+        auto [it, inserted] = currentStreamers.try_emplace(name, streamerConfig);
+        if(!inserted)
+            continue;
+
+        Log()->info("Adding streamer \"{}\"...", name);
+
+        AddStreamer(config, sharedData, name, it->second, mountPoints, &cleanupList, &monitorList);
+        ++added;
+    }
+
+    if(!removed && !added && !updated) {
+        Log()->info("Streamers are unchanged");
+        return;
+    }
+
+    sharedData->publicListCache = GenerateList(*config, ListType::Public);
+    sharedData->protectedListCache = GenerateList(*config, ListType::Protected);
+    sharedData->agentListCache = GenerateList(*config, ListType::Agent);
+
+    sharedData->routes = StreamerRoutes(*config);
+    for(const auto& [streamerName, mountPoint]: *mountPoints)
+        sharedData->routes.setMountPoint(streamerName, mountPoint.streamer.get(), mountPoint.state);
+
+    // monitors have to be removed before the ones for changed streamers are added again
+    if(!removedRecordings.empty() && monitors->recordingsCleanupActor) {
+        monitors->recordingsCleanupActor->postAction(
+            std::bind(
+                RemoveRecordingsMonitorsAction,
+                std::ref(*monitors->recordingsCleanupContext),
+                std::move(removedRecordings)));
+    }
+    if(!removedFilesMonitors.empty() && monitors->filesMonitorsActor) {
+        monitors->filesMonitorsActor->postAction(
+            std::bind(
+                RemoveFilesMonitorsAction,
+                std::ref(*monitors->filesMonitorsContext),
+                std::move(removedFilesMonitors)));
+    }
+
+    if(!updatedFilesMonitors.empty() && monitors->filesMonitorsActor) {
+        monitors->filesMonitorsActor->postAction(
+            std::bind(
+                UpdateFilesMonitorsAction,
+                std::ref(*monitors->filesMonitorsContext),
+                std::move(updatedFilesMonitors)));
+    }
+
+    StartRecordingsCleanup(monitors, cleanupList);
+    StartFilesMonitors(monitors, mainContext, sharedData, monitorList);
+
+    Log()->info("Streamers reloaded. {} removed, {} added, {} updated", removed, added, updated);
+}
+
+namespace {
+
+void AppendMetricHeader(std::string* out, std::string_view name, std::string_view type, std::string_view help)
+{
+    fmt::format_to(std::back_inserter(*out), "# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+}
+
+template<typename T>
+void AppendMetric(std::string* out, std::string_view name, T value)
+{
+    fmt::format_to(std::back_inserter(*out), "{} {}\n", name, value);
+}
+
+// label values can come from agents, so anything breaking exposition format is escaped
+template<typename T>
+void AppendMetric(
+    std::string* out,
+    std::string_view name,
+    std::string_view label,
+    std::string_view labelValue,
+    T value)
+{
+    auto outIt = std::back_inserter(*out);
+    fmt::format_to(outIt, "{}{{{}=\"", name, label);
+    for(const char c: labelValue) {
+        switch(c) {
+        case '\\':
+            out->append("\\\\");
+            break;
+        case '"':
+            out->append("\\\"");
+            break;
+        case '\n':
+            out->append("\\n");
+            break;
+        default:
+            out->push_back(c);
+            break;
+        }
+    }
+    fmt::format_to(outIt, "\"}} {}\n", value);
+}
+
+double Seconds(std::chrono::microseconds duration)
+{
+    return std::chrono::duration<double>(duration).count();
+}
+
+}
+
+static std::string CollectMetrics(
+    const Config* config,
+    const MountPoints* mountPoints,
+    const Session::SharedData* sharedData,
+    const BackgroundMonitors* monitors)
+{
+    DispatchScope dispatchScope("metrics_collect");
+
+    std::string out;
+
+    AppendMetricHeader(&out, "restreamer_sessions", "gauge", "Connected sessions");
+    AppendMetric(&out, "restreamer_sessions", sharedData->sessionsCount);
+
+    AppendMetricHeader(&out, "restreamer_streamers", "gauge", "Configured streamers");
+    AppendMetric(&out, "restreamer_streamers", config->streamers.size());
+
+    AppendMetricHeader(&out, "restreamer_mounts", "gauge", "Instantiated mount points");
+    AppendMetric(&out, "restreamer_mounts", "kind", "static", mountPoints->size());
+    AppendMetric(&out, "restreamer_mounts", "kind", "lazy", sharedData->lazyMounts.size());
+    AppendMetric(&out, "restreamer_mounts", "kind", "file_player", sharedData->filePlayerMounts.size());
+    AppendMetric(&out, "restreamer_mounts", "kind", "retired", sharedData->retiredMounts.size());
+
+    // every peer has media session of its own, so it's media sessions count too
+    AppendMetricHeader(&out, "restreamer_mount_peers", "gauge", "Live peers of static or lazy mount point");
+    for(const auto& [name, mountPoint]: *mountPoints)
+        AppendMetric(&out, "restreamer_mount_peers", "streamer", name, mountPoint.state->peers);
+    for(const auto& [name, mount]: sharedData->lazyMounts)
+        AppendMetric(&out, "restreamer_mount_peers", "streamer", name, mount.state->peers);
+
+    AppendMetricHeader(&out, "restreamer_peers_created_total", "counter", "Peers created per streamer");
+    for(const auto& [name, count]: sharedData->peersCreated)
+        AppendMetric(&out, "restreamer_peers_created_total", "streamer", name, count);
+
+    AppendMetricHeader(&out, "restreamer_viewers", "gauge", "Live peers counted against viewers limits");
+    for(const auto& [name, peers]: sharedData->streamersPeers)
+        AppendMetric(&out, "restreamer_viewers", "streamer", name, peers);
+    AppendMetricHeader(&out, "restreamer_viewers_rejected_total", "counter", "Viewers rejected by viewers limits");
+    AppendMetric(&out, "restreamer_viewers_rejected_total", sharedData->rejectedViewers);
+
+    const LazyMountsStats& lazyMountsStats = sharedData->lazyMountsStats;
+    AppendMetricHeader(&out, "restreamer_lazy_mounts_instantiated_total", "counter", "Lazy mount points instantiated");
+    AppendMetric(&out, "restreamer_lazy_mounts_instantiated_total", lazyMountsStats.instantiated);
+    AppendMetricHeader(&out, "restreamer_lazy_mounts_destroyed_total", "counter", "Idle lazy mount points destroyed");
+    AppendMetric(&out, "restreamer_lazy_mounts_destroyed_total", lazyMountsStats.destroyed);
+    AppendMetricHeader(
+        &out,
+        "restreamer_lazy_mount_instantiation_seconds",
+        "gauge",
+        "Time to instantiate lazy mount point and its first peer");
+    AppendMetric(
+        &out,
+        "restreamer_lazy_mount_instantiation_seconds", "stat", "last",
+        Seconds(lazyMountsStats.lastInstantiationTime));
+    AppendMetric(
+        &out,
+        "restreamer_lazy_mount_instantiation_seconds", "stat", "max",
+        Seconds(lazyMountsStats.maxInstantiationTime));
+
+    AppendMetricHeader(&out, "restreamer_proxy_agents", "gauge", "Agents connected to Proxy mount point");
+    for(const auto& [name, agents]: sharedData->agentsMountpoints)
+        AppendMetric(&out, "restreamer_proxy_agents", "streamer", name, agents.size());
+
+    AppendMetricHeader(
+        &out,
+        "restreamer_forwarded_requests_in_flight",
+        "gauge",
+        "Requests forwarded to agents and waiting for response");
+    AppendMetric(&out, "restreamer_forwarded_requests_in_flight", sharedData->forwardedRequestsInFlight);
+
+    AppendMetricHeader(&out, "restreamer_auth_tokens", "gauge", "Issued auth tokens");
+    AppendMetric(&out, "restreamer_auth_tokens", sharedData->authTokens.size());
+    AppendMetricHeader(&out, "restreamer_auth_tokens_expired_total", "counter", "Expired auth tokens");
+    AppendMetric(&out, "restreamer_auth_tokens_expired_total", sharedData->authTokensStats.expired);
+
+    AppendMetricHeader(&out, "restreamer_list_bytes", "gauge", "Size of cached streamers list");
+    AppendMetric(&out, "restreamer_list_bytes", "list", "public", sharedData->publicListCache->size());
+    AppendMetric(&out, "restreamer_list_bytes", "list", "protected", sharedData->protectedListCache->size());
+    AppendMetric(&out, "restreamer_list_bytes", "list", "agent", sharedData->agentListCache->size());
+
+    AppendMetricHeader(&out, "restreamer_mount_list_bytes", "gauge", "Size of cached mount point list");
+    for(const auto& [name, listCache]: sharedData->mountpointsListsCache)
+        AppendMetric(&out, "restreamer_mount_list_bytes", "streamer", name, listCache.list ? listCache.list->size() : 0);
+
+    if(monitors->recordingsCleanupContext) {
+        AppendMetricHeader(&out, "restreamer_recordings_bytes", "gauge", "Size of all recordings");
+        AppendMetric(&out, "restreamer_recordings_bytes", monitors->recordingsCleanupContext->recordingsSize.load());
+    }
+
+    const MainLoopStats& mainLoopStats = sharedData->mainLoopStats;
+    AppendMetricHeader(&out, "restreamer_main_loop_latency_seconds", "summary", "Timer dispatch delay");
+    AppendMetric(&out, "restreamer_main_loop_latency_seconds_sum", Seconds(mainLoopStats.latencySum));
+    AppendMetric(&out, "restreamer_main_loop_latency_seconds_count", mainLoopStats.probes);
+    AppendMetricHeader(&out, "restreamer_main_loop_last_latency_seconds", "gauge", "Last timer dispatch delay");
+    AppendMetric(&out, "restreamer_main_loop_last_latency_seconds", Seconds(mainLoopStats.lastLatency));
+
+    AppendMainLoopProfilerMetrics(&out);
+
+    return out;
 }
 
 int ReStreamerMain(
     const http::Config& httpConfig,
-    const Config& config,
-    bool useGlobalDefaultContext)
+    const Config& initialConfig,
+    bool useGlobalDefaultContext,
+    const LoadStreamersConfig& loadStreamersConfig,
+    const PublicIPChanged& publicIPChanged,
+    const StartBackgroundTasks& startBackgroundTasks)
 {
+    // streamers can be changed on reload
+    Config config = initialConfig;
+
     GMainContextPtr contextPtr(
         useGlobalDefaultContext ?
             g_main_context_ref(g_main_context_default()) :
@@ -616,98 +1556,42 @@ int ReStreamerMain(
         .publicListCache = GenerateList(config, ListType::Public),
         .protectedListCache = GenerateList(config, ListType::Protected),
         .agentListCache = GenerateList(config, ListType::Agent),
+        .routes = StreamerRoutes(config),
     };
 
     std::deque<RecordConfig> cleanupList;
-    std::deque<std::pair<std::string, std::string>> monitorList;
+    std::deque<std::pair<std::string, StreamerConfig>> monitorList;
 
+    const auto mountPointsCreationStartedAt = std::chrono::steady_clock::now();
     MountPoints mountPoints;
-    for(const auto& pair: config.streamers) {
-        if((pair.second.type != StreamerConfig::Type::Record || !pair.second.recordConfig) && !pair.second.restream)
-            continue;
+    for(const auto& [name, streamerConfig]: config.streamers)
+        AddStreamer(&config, &sessionsSharedData, name, streamerConfig, &mountPoints, &cleanupList, &monitorList);
+    LogStartupPhase("Mount points creation", mountPointsCreationStartedAt);
 
-        switch(pair.second.type) {
-        case StreamerConfig::Type::Test:
-            mountPoints.emplace(pair.first, std::make_unique<GstTestStreamer2>(pair.second.uri));
-            break;
-        case StreamerConfig::Type::ReStreamer:
-            mountPoints.emplace(
-                pair.first,
-                std::make_unique<GstReStreamer2>(
-                    pair.second.uri,
-                    pair.second.forceH264ProfileLevelId));
-            break;
-#if ONVIF_SUPPORT
-        case StreamerConfig::Type::ONVIFReStreamer:
-            mountPoints.emplace(
-                pair.first,
-                std::make_unique<ONVIFReStreamer>(
-                    pair.second.uri,
-                    pair.second.forceH264ProfileLevelId,
-                    pair.second.username,
-                    pair.second.password));
-            break;
-#endif
-        case StreamerConfig::Type::Record:
-            if(pair.second.recordConfig) {
-                cleanupList.push_back(*pair.second.recordConfig);
-            }
-            typedef GstRecordStreamer::RecordOptions RecordOptions;
-            mountPoints.emplace(
-                pair.first,
-                std::make_unique<GstRecordStreamer>(
-                    pair.second.recordConfig ?
-                        std::optional<RecordOptions>({
-                            pair.second.recordConfig->dir,
-                            pair.second.recordConfig->maxFileSize}) :
-                        std::optional<RecordOptions>(),
-                    std::bind(OnRecorderConnected, &sessionsSharedData, pair.first),
-                    std::bind(OnRecorderDisconnected, &sessionsSharedData, pair.first)));
-            break;
-        case StreamerConfig::Type::FilePlayer:
-            monitorList.emplace_back(pair.first, pair.second.uri);
-            break;
-        case StreamerConfig::Type::Pipeline:
-            mountPoints.emplace(
-                pair.first,
-                std::make_unique<GstPipelineStreamer2>(pair.second.pipeline));
-            break;
-        case StreamerConfig::Type::Camera: {
-            const std::optional<CameraConfig>& cameraConfig = pair.second.cameraConfig;
-            std::optional<GstCameraStreamer::VideoResolution> resolution;
-            std::optional<unsigned> framerate;
-            if(cameraConfig) {
-                if(cameraConfig->resolution) {
-                    resolution = GstCameraStreamer::VideoResolution {
-                        cameraConfig->resolution->width,
-                        cameraConfig->resolution->height };
-                }
-                framerate = cameraConfig->framerate;
-            }
-            mountPoints.emplace(
-                pair.first,
-                std::make_unique<GstCameraStreamer>(
-                    resolution,
-                    framerate,
-                    std::optional<std::string>(),
-                    pair.second.useHwEncoder));
-            break;
-        }
-        case StreamerConfig::Type::V4L2:
-            mountPoints.emplace(
-                pair.first,
-                std::make_unique<GstV4L2ReStreamer>(
-                    pair.second.edidFilePath,
-                    std::optional<GstV4L2ReStreamer::VideoResolution>(),
-                    std::optional<std::string>(),
-                    pair.second.useHwEncoder));
-            break;
-        default:
-            break;
-        }
-    }
+    for(const auto& [streamerName, mountPoint]: mountPoints)
+        sessionsSharedData.routes.setMountPoint(streamerName, mountPoint.streamer.get(), mountPoint.state);
 
     ScheduleAuthTokensCleanup(&sessionsSharedData);
+    ScheduleMountsCleanup(&config, &sessionsSharedData);
+    ScheduleMainLoopLatencyProbe(&sessionsSharedData);
+    if(config.mainLoopProfiler)
+        EnableMainLoopProfiler(context, config.slowDispatchThreshold);
+
+    // Coturn endpoint handed out to agents follows public IP changes
+    std::unique_ptr<PublicIPDetector> publicIPDetectorPtr;
+#if !defined(BUILD_AS_CAMERA_STREAMER) && !defined(BUILD_AS_V4L2_RESTREAMER)
+    if(config.useServerMode() && config.agentsConfig.useCoturn) {
+        publicIPDetectorPtr = std::make_unique<PublicIPDetector>(
+            *config.webRTCConfig,
+            PublicIPRecheckInterval,
+            [&config, &publicIPChanged] (const std::string& publicIp) {
+                config.publicIp = publicIp;
+                if(publicIPChanged)
+                    publicIPChanged(publicIp);
+            });
+        publicIPDetectorPtr->start();
+    }
+#endif
 
     lws_context_creation_info lwsInfo {};
     lwsInfo.gid = -1;
@@ -740,7 +1624,6 @@ int ReStreamerMain(
             std::bind(
                 CreateSignallingSession,
                 &config,
-                &mountPoints,
                 &sessionsSharedData,
                 std::placeholders::_1,
                 std::placeholders::_2),
@@ -755,7 +1638,6 @@ int ReStreamerMain(
             std::bind(
                 CreateSession,
                 &config,
-                &mountPoints,
                 &sessionsSharedData,
                 std::placeholders::_1,
                 std::placeholders::_2));
@@ -771,40 +1653,59 @@ int ReStreamerMain(
                 context);
     }
 
-    std::unique_ptr<RecordingsCleanupContext> recordingsCleanupContext;
-    std::unique_ptr<Actor> recordingsCleanupActor;
-    if(!cleanupList.empty()) {
-        recordingsCleanupContext = std::make_unique<RecordingsCleanupContext>();
-        recordingsCleanupActor = std::make_unique<Actor>();
-        recordingsCleanupActor->postAction(
-            std::bind(
-                RecordingsCleanupInitAction,
-                std::ref(*recordingsCleanupContext),
-                std::ref(cleanupList)));
+    BackgroundMonitors monitors;
+    StartRecordingsCleanup(&monitors, cleanupList);
+    StartFilesMonitors(&monitors, context, &sessionsSharedData, monitorList);
+
+    std::unique_ptr<MetricsServer> metricsServerPtr;
+    if(config.metricsPort) {
+        metricsServerPtr =
+            std::make_unique<MetricsServer>(
+                *config.metricsPort,
+                config.bindToLoopbackOnly,
+                std::bind(CollectMetrics, &config, &mountPoints, &sessionsSharedData, &monitors));
     }
 
-    std::unique_ptr<FilesMonitorsContext> filesMonitorsContext;
-    std::unique_ptr<Actor> filesMonitorsActor;
-    if(!monitorList.empty()) {
-        filesMonitorsContext =
-            std::make_unique<FilesMonitorsContext>(
-                GMainContextPtr(g_main_context_ref(contextPtr.get())),
-                &sessionsSharedData);
-        filesMonitorsActor = std::make_unique<Actor>();
-        filesMonitorsActor->postAction(
+    std::function<void ()> reloadStreamers;
+    if(loadStreamersConfig) {
+        reloadStreamers =
             std::bind(
-                FilesMonitorsInitAction,
-                std::ref(*filesMonitorsContext),
-                std::ref(monitorList)));
+                ReloadStreamers,
+                std::cref(loadStreamersConfig),
+                &config,
+                &mountPoints,
+                &sessionsSharedData,
+                &monitors,
+                context);
+
+        GSourcePtr signalSourcePtr(g_unix_signal_source_new(SIGHUP));
+        GSource* signalSource = signalSourcePtr.get();
+        g_source_set_callback(
+            signalSource,
+            [] (gpointer userData) -> gboolean {
+                DispatchScope dispatchScope("streamers_reload");
+                (*static_cast<std::function<void ()>*>(userData))();
+                return true;
+            },
+            &reloadStreamers,
+            nullptr);
+        g_source_attach(signalSource, context);
     }
 
+    const auto serversInitStartedAt = std::chrono::steady_clock::now();
     if((!httpServerPtr || httpServerPtr->init()) &&
+        (!metricsServerPtr || metricsServerPtr->init()) &&
         (!serverPtr || serverPtr->init(lwsContext)) &&
         (!signallingClient || signallingClient->init()))
     {
+        LogStartupPhase("Servers initialization", serversInitStartedAt);
+
         if(signallingClient)
             signallingClient->connect();
 
+        if(startBackgroundTasks)
+            startBackgroundTasks(&config);
+
         g_main_loop_run(loop);
     } else
         return -1;
@@ -1,11 +1,25 @@
 #pragma once
 
+#include <functional>
+#include <map>
+#include <string>
+
 #include "Http/Config.h"
 
 #include "Config.h"
 
 
+// used to reload streamers on SIGHUP
+typedef std::function<bool (std::map<std::string, StreamerConfig>*)> LoadStreamersConfig;
+// used to update services depending on public IP (i.e. Coturn)
+typedef std::function<void (const std::string& publicIp)> PublicIPChanged;
+// called right before main loop start, with config used by running sessions
+typedef std::function<void (Config* runningConfig)> StartBackgroundTasks;
+
 int ReStreamerMain(
     const http::Config&,
     const Config&,
-    bool useGlobalDefaultContext);
+    bool useGlobalDefaultContext,
+    const LoadStreamersConfig& = LoadStreamersConfig(),
+    const PublicIPChanged& = PublicIPChanged(),
+    const StartBackgroundTasks& = StartBackgroundTasks());
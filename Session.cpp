@@ -1,12 +1,17 @@
 #include "Session.h"
 
+#include <algorithm>
+#include <vector>
+
 #include <glib.h>
 
 #include "RtspParser/RtspParser.h"
 #include "RtspParser/RtspSerialize.h"
 #include "Helpers/TurnRestApi.h"
 
+#include "ListCache.h"
 #include "Log.h"
+#include "MainLoopProfiler.h"
 
 
 class Session::SessionHandle
@@ -24,51 +29,91 @@ private:
 Session::Session(
     const Config* config,
     SharedData* sharedData,
-    const CreatePeer& createPeer,
+    const PeerLeases::CreatePeer& createPeer,
     const rtsp::Session::SendRequest& sendRequest,
     const rtsp::Session::SendResponse& sendResponse) noexcept :
-    ServerSession(config->webRTCConfig, createPeer, sendRequest, sendResponse),
+    ServerSession(
+        config->webRTCConfig,
+        std::bind(&PeerLeases::createPeer, &_peerLeases, createPeer, std::placeholders::_1),
+        sendRequest,
+        [this, sendResponse] (const rtsp::Response& response) {
+            _peerLeases.onResponse(response);
+            return sendResponse(response);
+        }),
     _config(config),
     _sharedData(sharedData),
     _log(MakeReStreamerLogger(sessionLogId)),
-    _handle(std::make_shared<SessionHandle>(this))
+    _handle(std::make_shared<SessionHandle>(this)),
+    _peerLeases(sharedData)
 {
+    ++_sharedData->sessionsCount;
 }
 
 Session::Session(
     const Config* config,
     SharedData* sharedData,
-    const CreatePeer& createPeer,
-    const CreatePeer& createRecordPeer,
+    const PeerLeases::CreatePeer& createPeer,
+    const CreateRecordPeer& createRecordPeer,
     const rtsp::Session::SendRequest& sendRequest,
     const rtsp::Session::SendResponse& sendResponse) noexcept :
-    ServerSession(config->webRTCConfig, createPeer, createRecordPeer, sendRequest, sendResponse),
+    ServerSession(
+        config->webRTCConfig,
+        std::bind(&PeerLeases::createPeer, &_peerLeases, createPeer, std::placeholders::_1),
+        [this, createRecordPeer] (const std::string& uri) -> std::unique_ptr<WebRTCPeer> {
+            const StreamerRoute* route = findStreamerRoute(uri);
+            return route ? createRecordPeer(*route) : nullptr;
+        },
+        sendRequest,
+        [this, sendResponse] (const rtsp::Response& response) {
+            _peerLeases.onResponse(response);
+            return sendResponse(response);
+        }),
     _config(config),
     _sharedData(sharedData),
     _log(MakeReStreamerLogger(sessionLogId)),
-    _handle(std::make_shared<SessionHandle>(this))
+    _handle(std::make_shared<SessionHandle>(this)),
+    _peerLeases(sharedData)
 {
+    ++_sharedData->sessionsCount;
 }
 
 Session::~Session() {
+    --_sharedData->sessionsCount;
+
     for(auto& pair: _sharedData->recordMountpointsData) {
         RecordMountpointData& data = pair.second;
         data.subscriptions.erase(this);
     }
 
+    // surviving agents keep serving mount point
     auto& agentsMountpoints = _sharedData->agentsMountpoints;
     for(auto it = agentsMountpoints.begin(); it != agentsMountpoints.end();) {
-        if(it->second == this) {
+        std::vector<AgentMountpointData>& agents = it->second;
+        const auto agentIt = std::find_if(
+            agents.begin(),
+            agents.end(),
+            [this] (const AgentMountpointData& data) { return data.agent == this; });
+        if(agentIt == agents.end()) {
+            ++it;
+            continue;
+        }
+
+        agents.erase(agentIt);
+        if(agents.empty()) {
             it = agentsMountpoints.erase(it);
         } else {
+            rebuildAgentsList(it->first);
             ++it;
         }
     }
 
-    for(auto it = _forwardedRequests.begin(); it != _forwardedRequests.end();) {
-        const rtsp::CSeq cseq = it->first;
-        ++it;
+    // every response removes entry from _forwardedRequests
+    std::vector<rtsp::CSeq> forwardedCSeqs;
+    forwardedCSeqs.reserve(_forwardedRequests.size());
+    for(const auto& [cseq, forwardedRequest]: _forwardedRequests)
+        forwardedCSeqs.push_back(cseq);
 
+    for(const rtsp::CSeq cseq: forwardedCSeqs) {
         std::unique_ptr<rtsp::Response > responsePtr = std::make_unique<rtsp::Response>();
         prepareResponse(
             rtsp::StatusCode::BAD_GATEWAY,
@@ -99,32 +144,41 @@ Session::~Session() {
     _agentMediaSessions2clientMediaSession.clear();
 }
 
-bool Session::playEnabled(const std::string& uri) noexcept
+const StreamerRoute* Session::findRoute(std::string_view uri, std::string_view* substream) noexcept
 {
-    auto it = _config->streamers.find(uri);
-    bool isSubstream = false;
+    const std::string_view streamerName = StreamerRoutes::SplitUri(uri, substream);
 
-    if(it == _config->streamers.end()) {
-        const std::string::size_type separatorPos = uri.find_first_of(rtsp::UriSeparator);
-        if(separatorPos == std::string::npos) {
-            return false;
-        }
-
-        const std::string streamerName = uri.substr(0, separatorPos);
-        it = _config->streamers.find(streamerName);
-        isSubstream = true;
+    const uint64_t routesVersion = _sharedData->routes.version();
+    if(_routeCache.routesVersion != routesVersion || _routeCache.streamerName != streamerName) {
+        _routeCache.routesVersion = routesVersion;
+        _routeCache.streamerName = streamerName;
+        _routeCache.route = _sharedData->routes.find(streamerName);
     }
 
-    if(it == _config->streamers.end())
+    return _routeCache.route;
+}
+
+const StreamerRoute* Session::findStreamerRoute(std::string_view uri) noexcept
+{
+    std::string_view substream;
+    const StreamerRoute* route = findRoute(uri, &substream);
+    return substream.data() ? nullptr : route;
+}
+
+bool Session::playEnabled(const std::string& uri) noexcept
+{
+    std::string_view substream;
+    const StreamerRoute* route = findRoute(uri, &substream);
+    if(!route)
         return false;
 
-    const StreamerConfig& streamerConfig = it->second;
+    const bool isSubstream = substream.data() != nullptr;
 
-    if(streamerConfig.type == StreamerConfig::Type::Record) {
-        return streamerConfig.restream;
+    if(route->type == StreamerConfig::Type::Record) {
+        return route->restream;
     }
 
-    if(streamerConfig.type == StreamerConfig::Type::FilePlayer) {
+    if(route->type == StreamerConfig::Type::FilePlayer) {
         return isSubstream;
     }
 
@@ -133,29 +187,25 @@ bool Session::playEnabled(const std::string& uri) noexcept
 
 bool Session::recordEnabled(const std::string& uri) noexcept
 {
-    auto it = _config->streamers.find(uri);
-    return
-        it != _config->streamers.end() &&
-        it->second.type == StreamerConfig::Type::Record;
+    const StreamerRoute* route = findStreamerRoute(uri);
+    return route && route->type == StreamerConfig::Type::Record;
 }
 
 bool Session::subscribeEnabled(const std::string& uri) noexcept
 {
-    auto it = _config->streamers.find(uri);
-    return
-        it != _config->streamers.end() &&
-        it->second.type == StreamerConfig::Type::Record;
+    const StreamerRoute* route = findStreamerRoute(uri);
+    return route && route->type == StreamerConfig::Type::Record;
 }
 
 bool Session::authorizeAgent(const std::unique_ptr<rtsp::Request>& requestPtr) noexcept
 {
-    auto it = _config->streamers.find(requestPtr->uri);
-    if(it == _config->streamers.end()) {
+    const StreamerRoute* route = findStreamerRoute(requestPtr->uri);
+    if(!route) {
         log()->error("Can't find streamer \"{}\"", requestPtr->uri);
         return false;
     }
 
-    switch(it->second.type) {
+    switch(route->type) {
     case StreamerConfig::Type::Record:
     case StreamerConfig::Type::Proxy:
         break;
@@ -163,7 +213,8 @@ bool Session::authorizeAgent(const std::unique_ptr<rtsp::Request>& requestPtr) n
         return false;
     }
 
-    if(it->second.remoteAgentToken.empty())
+    const std::string& remoteAgentToken = route->config->remoteAgentToken;
+    if(remoteAgentToken.empty())
         return true;
 
     const std::pair<rtsp::Authentication, std::string> authPair =
@@ -172,7 +223,7 @@ bool Session::authorizeAgent(const std::unique_ptr<rtsp::Request>& requestPtr) n
     if(authPair.first != rtsp::Authentication::Bearer) // FIXME? only Bearer supported atm
         return false;
 
-    return authPair.second == it->second.remoteAgentToken;
+    return authPair.second == remoteAgentToken;
 }
 
 bool Session::isValidCookie(const std::optional<std::string>& authCookie) noexcept
@@ -195,21 +246,13 @@ bool Session::isValidCookie(const std::optional<std::string>& authCookie) noexce
 bool Session::authorize(const std::unique_ptr<rtsp::Request>& requestPtr) noexcept
 {
     auto authRequired = [this, &requestPtr] () {
-        bool authRequired = true;
+        // LIST uri can have query with pagination parameters
+        const std::string_view uri = SplitListUri(requestPtr->uri).first;
+        if(uri == rtsp::WildcardUri)
+            return requestPtr->method != rtsp::Method::LIST && _config->authRequired;
 
-        if(requestPtr->uri == rtsp::WildcardUri) {
-            authRequired = requestPtr->method != rtsp::Method::LIST && _config->authRequired;
-        } else {
-            const auto& [streamerName, substreamName] = rtsp::SplitUri(requestPtr->uri);
-            auto streamerIt = _config->streamers.find(streamerName);
-            typedef StreamerConfig::Visibility Visibility;
-            authRequired =
-                streamerIt != _config->streamers.end() &&
-                (streamerIt->second.visibility == Visibility::Protected ||
-                    (_config->authRequired && streamerIt->second.visibility == Visibility::Auto));
-        }
-
-        return authRequired;
+        const StreamerRoute* route = findRoute(uri);
+        return route && route->authRequired;
     };
 
     switch(requestPtr->method) {
@@ -236,6 +279,8 @@ bool Session::authorize(const std::unique_ptr<rtsp::Request>& requestPtr) noexce
 bool Session::onGetParameterRequest(
     std::unique_ptr<rtsp::Request>&& requestPtr) noexcept
 {
+    DispatchScope dispatchScope("get_parameter_request");
+
     const std::string& contentType = rtsp::RequestContentType(*requestPtr);
 
     if(contentType.empty())
@@ -292,73 +337,74 @@ bool Session::onGetParameterRequest(
 }
 #endif
 
-bool Session::listEnabled(const std::string& uri) noexcept
+bool Session::listEnabled(const std::string& listUri) noexcept
 {
+    const std::string_view uri = SplitListUri(listUri).first;
     if(uri == rtsp::WildcardUri)
         return true;
 
-    auto streamerIt = _config->streamers.find(uri);
-    if(streamerIt == _config->streamers.end())
+    const StreamerRoute* route = findStreamerRoute(uri);
+    if(!route)
         return false;
 
-    if(
-        streamerIt->second.type == StreamerConfig::Type::FilePlayer ||
-        streamerIt->second.type == StreamerConfig::Type::Proxy)
-    {
-        return true;
-    }
-
-    return false;
+    return
+        route->type == StreamerConfig::Type::FilePlayer ||
+        route->type == StreamerConfig::Type::Proxy;
 }
 
 bool Session::onListRequest(
     std::unique_ptr<rtsp::Request>&& requestPtr) noexcept
 {
-    const std::string& uri = requestPtr->uri;
+    DispatchScope dispatchScope("list_request");
+
     const std::string& contentType = rtsp::RequestContentType(*requestPtr);
 
-    if(!listEnabled(uri))
+    if(!listEnabled(requestPtr->uri))
         return false;
 
+    const auto [listUri, listQuery] = SplitListUri(requestPtr->uri);
+    const std::string uri(listUri);
+    const bool paginated = !listQuery.empty();
+
     if(uri == rtsp::WildcardUri) {
-        if(!contentType.empty() || !requestPtr->body.empty()) {
+        if(paginated || !contentType.empty() || !requestPtr->body.empty()) {
             return false;
         } else if(isValidCookie(authCookie())) {
-            sendOkResponse(requestPtr->cseq, rtsp::TextParametersContentType, _sharedData->protectedListCache);
+            sendOkResponse(requestPtr->cseq, rtsp::TextParametersContentType, *_sharedData->protectedListCache);
         } else {
-            sendOkResponse(requestPtr->cseq, rtsp::TextParametersContentType, _sharedData->publicListCache);
+            sendOkResponse(requestPtr->cseq, rtsp::TextParametersContentType, *_sharedData->publicListCache);
         }
 
         return true;
     }
 
-    auto streamerIt = _config->streamers.find(uri);
-    if(streamerIt == _config->streamers.end())
+    const StreamerRoute* route = findStreamerRoute(uri);
+    if(!route)
         return false;
 
-    if(streamerIt->second.type != StreamerConfig::Type::Proxy &&
+    if(route->type != StreamerConfig::Type::Proxy &&
         (!contentType.empty() || !requestPtr->body.empty()))
     {
         return false;
     }
 
+    ListQuery query;
+    if(paginated && (!contentType.empty() || !ParseListQuery(listQuery, &query)))
+        return false;
+
     auto sendCachedListResponse =
-        [this, &uri, cseq = requestPtr->cseq] () {
+        [this, &uri, paginated, &query, cseq = requestPtr->cseq] () {
             auto listIt = _sharedData->mountpointsListsCache.find(uri);
             if(listIt == _sharedData->mountpointsListsCache.end()) {
-                sendOkResponse(
-                    cseq,
-                    rtsp::TextParametersContentType,
-                    "\r\n");
+                sendOkResponse(cseq, rtsp::TextParametersContentType, EmptyList);
+            } else if(paginated) {
+                sendOkResponse(cseq, rtsp::TextParametersContentType, SelectListPage(listIt->second, query));
             } else {
-                sendOkResponse(
-                    cseq,
-                    rtsp::TextParametersContentType,
-                    listIt->second);
+                sendOkResponse(cseq, rtsp::TextParametersContentType, *listIt->second.list);
             }
         };
 
-    switch(streamerIt->second.type) {
+    switch(route->type) {
         case StreamerConfig::Type::FilePlayer: {
             sendCachedListResponse();
             return true;
@@ -369,17 +415,7 @@ bool Session::onListRequest(
             } else {
                 rtsp::Parameters inList;
                 if(rtsp::ParseParameters(requestPtr->body, &inList)) {
-                    std::string list;
-                    for(auto& name2desc: inList) {
-                        list += uri;
-                        list += rtsp::UriSeparator;
-                        list += name2desc.first;
-                        list += ": ";
-                        list += name2desc.second;
-                        list += "\r\n";
-                    }
-                    _sharedData->agentsMountpoints[uri] = this;
-                    _sharedData->mountpointsListsCache[uri] = list;
+                    updateAgentList(uri, std::move(inList));
                     sendOkResponse(requestPtr->cseq);
                 } else {
                     return false;
@@ -394,17 +430,90 @@ bool Session::onListRequest(
     return false;
 }
 
+void Session::updateAgentList(const std::string& uri, rtsp::Parameters&& list) noexcept
+{
+    std::vector<AgentMountpointData>& agents = _sharedData->agentsMountpoints[uri];
+    auto agentIt = std::find_if(
+        agents.begin(),
+        agents.end(),
+        [this] (const AgentMountpointData& data) { return data.agent == this; });
+    if(agentIt == agents.end()) {
+        agents.push_back(AgentMountpointData { this, std::move(list) });
+        if(agents.size() > 1)
+            log()->info("Agent joined \"{}\". Agents count: {}", uri, agents.size());
+    } else {
+        agentIt->list = std::move(list);
+    }
+
+    rebuildAgentsList(uri);
+}
+
+// mount point list is union of lists reported by all agents
+void Session::rebuildAgentsList(const std::string& uri) noexcept
+{
+    auto agentsIt = _sharedData->agentsMountpoints.find(uri);
+    if(agentsIt == _sharedData->agentsMountpoints.end())
+        return;
+
+    const std::vector<AgentMountpointData>& agents = agentsIt->second;
+
+    std::map<std::string_view, std::string_view> mergedList;
+    for(const AgentMountpointData& agentData: agents)
+        mergedList.insert(agentData.list.begin(), agentData.list.end());
+
+    MountpointListCacheBuilder listBuilder;
+    std::string line;
+    for(const auto& [name, description]: mergedList) {
+        line = uri;
+        line += rtsp::UriSeparator;
+        line += name;
+        line += ": ";
+        line += description;
+        line += "\r\n";
+        listBuilder.add(line, uri.size() + 1);
+    }
+
+    MountpointListCache& listCache = _sharedData->mountpointsListsCache[uri];
+    listCache = listBuilder.build(listCache.version + 1);
+}
+
+// picks least loaded agent among ones reported substream
+Session* Session::selectAgent(const std::string& uri, const std::string& substream) noexcept
+{
+    auto agentsIt = _sharedData->agentsMountpoints.find(uri);
+    if(agentsIt == _sharedData->agentsMountpoints.end())
+        return nullptr;
+
+    Session* selectedAgent = nullptr;
+    bool selectedHasSubstream = false;
+    size_t selectedLoad = 0;
+    for(const AgentMountpointData& agentData: agentsIt->second) {
+        const bool hasSubstream = agentData.list.find(substream) != agentData.list.end();
+        const size_t load = agentData.agent->proxyLoad();
+        if(!selectedAgent ||
+            (hasSubstream && !selectedHasSubstream) ||
+            (hasSubstream == selectedHasSubstream && load < selectedLoad))
+        {
+            selectedAgent = agentData.agent;
+            selectedHasSubstream = hasSubstream;
+            selectedLoad = load;
+        }
+    }
+
+    return selectedAgent;
+}
+
 bool Session::onSubscribeRequest(
     std::unique_ptr<rtsp::Request>&& requestPtr) noexcept
 {
-    auto it = _config->streamers.find(requestPtr->uri);
-    if(it == _config->streamers.end())
+    const StreamerRoute* route = findStreamerRoute(requestPtr->uri);
+    if(!route)
         return false;
 
-    if(it->second.type != StreamerConfig::Type::Record)
+    if(route->type != StreamerConfig::Type::Record)
         return false;
 
-    if(!it->second.restream)
+    if(!route->restream)
         return false;
 
     RecordMountpointData& data = _sharedData->recordMountpointsData[requestPtr->uri];
@@ -424,12 +533,50 @@ bool Session::onSubscribeRequest(
 
     if(data.recording) {
         log()->info("Streamer \"{}\" already active. Starting record to client...", requestPtr->uri);
-        startRecordToClient(requestPtr->uri, mediaSessionId);
+        startRecordToSubscriber(*route, requestPtr->uri, mediaSessionId);
     }
 
     return true;
 }
 
+bool Session::admitViewer(const StreamerRoute& route, const rtsp::Request& request) noexcept
+{
+    rtsp::StatusCode statusCode;
+    const char* reasonPhrase;
+    if(_peerLeases.admitViewer(*_config, route, &statusCode, &reasonPhrase))
+        return true;
+
+    rtsp::Response response;
+    prepareResponse(statusCode, reasonPhrase, request.cseq, std::string(), &response);
+    sendResponse(response);
+
+    return false;
+}
+
+bool Session::onDescribeRequest(
+    std::unique_ptr<rtsp::Request>&& requestPtr) noexcept
+{
+    const StreamerRoute* route = findRoute(requestPtr->uri);
+    if(route && playEnabled(requestPtr->uri) && !admitViewer(*route, *requestPtr))
+        return true;
+
+    _peerLeases.describeStarted(requestPtr->cseq, route);
+    const bool handled = ServerSession::onDescribeRequest(std::move(requestPtr));
+    _peerLeases.describeFinished(handled);
+
+    return handled;
+}
+
+void Session::startRecordToSubscriber(
+    const StreamerRoute& route,
+    const std::string& uri,
+    const rtsp::MediaSessionId& mediaSession) noexcept
+{
+    _peerLeases.recordStarted(mediaSession, &route);
+    startRecordToClient(uri, mediaSession);
+    _peerLeases.recordFinished();
+}
+
 bool Session::handleResponse(
     const rtsp::Request& request,
     std::unique_ptr<rtsp::Response>&& responsePtr) noexcept
@@ -439,6 +586,7 @@ bool Session::handleResponse(
         ForwardedRequest& sourceRequest = it->second;
         bool success = forwardResponse(sourceRequest, request, responsePtr);
         _forwardedRequests.erase(it);
+        --_sharedData->forwardedRequestsInFlight;
         return success;
     } else
         return ServerSession::handleResponse(request, std::move(responsePtr));
@@ -453,17 +601,14 @@ bool Session::isProxyRequest(const rtsp::Request& request) noexcept
         return true;
     }
 
-    const std::string& uri = request.uri;
-    const std::string& streamerName = rtsp::SplitUri(uri).first;
-    auto it = _config->streamers.find(streamerName);
-    if(it == _config->streamers.end())
-        return false;
-
-    return it->second.type == StreamerConfig::Type::Proxy;
+    const StreamerRoute* route = findRoute(request.uri);
+    return route && route->type == StreamerConfig::Type::Proxy;
 }
 
 bool Session::handleProxyRequest(std::unique_ptr<rtsp::Request>& requestPtr) noexcept
 {
+    DispatchScope dispatchScope("proxy_request");
+
     assert(isProxyRequest(*requestPtr));
 
     const rtsp::MediaSessionId& mediaSessionId = rtsp::RequestSession(*requestPtr);
@@ -485,7 +630,7 @@ bool Session::handleProxyRequest(std::unique_ptr<rtsp::Request>& requestPtr) noe
             sourceUri.swap(requestPtr->uri);
             requestPtr->uri = target.uri;
             rtsp::SetRequestSession(requestPtr.get(), target.mediaSession);
-            (*targetSession)->forwardRequest(_handle, sourceUri, mediaSessionId, requestPtr);
+            (*targetSession)->forwardRequest(_handle, std::move(sourceUri), mediaSessionId, requestPtr);
 
             return true;
         }
@@ -493,16 +638,13 @@ bool Session::handleProxyRequest(std::unique_ptr<rtsp::Request>& requestPtr) noe
 
     auto [streamerName, substream] = rtsp::SplitUri(requestPtr->uri);
 
-    auto agentMountpointIt = _sharedData->agentsMountpoints.find(streamerName);
-    if(agentMountpointIt == _sharedData->agentsMountpoints.end()) {
-        sendNotFoundResponse(requestPtr->cseq);
-        return true;
-    }
-
+    // requests for established media session go to agent owning it
+    std::shared_ptr<SessionHandle> agentSession;
     rtsp::MediaSessionId agentMediaSession;
     if(!mediaSessionId.empty()) {
         auto it = _clientMediaSession2agentMediaSession.find(mediaSessionId);
         if(it != _clientMediaSession2agentMediaSession.end()) {
+            agentSession = it->second.mediaSessionOwner.lock();
             agentMediaSession = it->second.mediaSession;
         }
 
@@ -512,6 +654,16 @@ bool Session::handleProxyRequest(std::unique_ptr<rtsp::Request>& requestPtr) noe
         assert(requestPtr->method == rtsp::Method::DESCRIBE);
     }
 
+    if(!agentSession && agentMediaSession.empty()) {
+        if(Session* selectedAgent = selectAgent(streamerName, substream))
+            agentSession = selectedAgent->_handle;
+    }
+
+    if(!agentSession) {
+        sendNotFoundResponse(requestPtr->cseq);
+        return true;
+    }
+
     assert(!substream.empty());
     std::string sourceUri;
     sourceUri.swap(requestPtr->uri);
@@ -519,29 +671,17 @@ bool Session::handleProxyRequest(std::unique_ptr<rtsp::Request>& requestPtr) noe
     if(!agentMediaSession.empty())
         rtsp::SetRequestSession(requestPtr.get(), agentMediaSession);
 
-    Session* agentSession = agentMountpointIt->second;
-    return agentSession->forwardRequest(_handle, sourceUri, mediaSessionId, requestPtr);
+    return (*agentSession)->forwardRequest(_handle, std::move(sourceUri), mediaSessionId, requestPtr);
 }
 
 bool Session::forwardRequest(
     std::shared_ptr<SessionHandle>& sourceSession,
-    const std::string& sourceUri,
+    std::string&& sourceUri,
     const std::string& sourceMediaSession,
     std::unique_ptr<rtsp::Request>& requestPtr) noexcept
 {
     rtsp::Request* attachedRequest = attachRequest(requestPtr);
 
-    if(requestPtr->cseq != rtsp::CSeq() && !sourceUri.empty()) { // source session doesn't need answer
-        assert(!requestPtr->uri.empty());
-        const bool added = _forwardedRequests.emplace(
-            attachedRequest->cseq,
-            ForwardedRequest {
-                sourceUri,
-                requestPtr->cseq,
-                sourceSession }).second;
-        assert(added);
-    }
-
     log()->debug(
         "Forwarding request:\n"
         "[{}] -> [{}]\n"
@@ -553,6 +693,18 @@ bool Session::forwardRequest(
         requestPtr->cseq, attachedRequest->cseq,
         sourceMediaSession, rtsp::RequestSession(*requestPtr));
 
+    if(requestPtr->cseq != rtsp::CSeq() && !sourceUri.empty()) { // source session doesn't need answer
+        assert(!requestPtr->uri.empty());
+        const bool added = _forwardedRequests.emplace(
+            attachedRequest->cseq,
+            ForwardedRequest {
+                std::move(sourceUri),
+                requestPtr->cseq,
+                sourceSession }).second;
+        assert(added);
+        ++_sharedData->forwardedRequestsInFlight;
+    }
+
     sendRequest(*attachedRequest);
 
     if(attachedRequest->method == rtsp::Method::TEARDOWN)
@@ -583,7 +735,8 @@ bool Session::forwardResponse(
     const rtsp::Request& request,
     std::unique_ptr<rtsp::Response>& responsePtr) noexcept
 {
-    const std::string sourceUri = sourceRequest.sourceUri;
+    // entry is removed right after response is forwarded
+    std::string sourceUri = std::move(sourceRequest.sourceUri);
     std::shared_ptr<SessionHandle> proxySession = sourceRequest.sourceSession.lock();
     const rtsp::CSeq sourceCSeq = sourceRequest.sourceCSeq;
 
@@ -608,7 +761,7 @@ bool Session::forwardResponse(
                 mediaSessionId,
                 MediaSessionInfo {
                     proxySession,
-                    sourceUri,
+                    std::move(sourceUri),
                     clientMediaSessionId });
 
             rtsp::SetResponseSession(responsePtr.get(), clientMediaSessionId);
@@ -659,10 +812,13 @@ void Session::teardownMediaSession(const rtsp::MediaSessionId& mediaSession) noe
     if(mediaSession.empty())
         return;
 
+    _peerLeases.release(mediaSession);
+
 #ifndef NDEBUG
+    // media sessions of own peers are in neither
     const bool hasClientSession = _clientMediaSession2agentMediaSession.count(mediaSession) != 0;
     const bool hasAgentSession = _agentMediaSessions2clientMediaSession.count(mediaSession) != 0;
-    assert(hasClientSession != hasAgentSession);
+    assert(!hasClientSession || !hasAgentSession);
 #endif
 
     if(_clientMediaSession2agentMediaSession.erase(mediaSession) == 0 &&
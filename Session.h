@@ -1,11 +1,16 @@
 #pragma once
 
+#include <cstdint>
 #include <map>
+#include <string>
+#include <string_view>
 #include <unordered_map>
 
 #include "RtspSession/ServerSession.h"
 
 #include "Config.h"
+#include "FlatHashMap.h"
+#include "PeerLeases.h"
 #include "SessionsSharedData.h"
 
 
@@ -15,18 +20,19 @@ public:
     typedef ::SessionAuthTokenData AuthTokenData;
     typedef ::RecordMountpointData RecordMountpointData;
     typedef SessionsSharedData SharedData;
+    typedef std::function<std::unique_ptr<WebRTCPeer> (const StreamerRoute&)> CreateRecordPeer;
 
     Session(
         const Config*,
         SharedData*,
-        const CreatePeer& createPeer,
+        const PeerLeases::CreatePeer& createPeer,
         const rtsp::Session::SendRequest& sendRequest,
         const rtsp::Session::SendResponse& sendResponse) noexcept;
     Session(
         const Config*,
         SharedData*,
-        const CreatePeer& createPeer,
-        const CreatePeer& createRecordPeer,
+        const PeerLeases::CreatePeer& createPeer,
+        const CreateRecordPeer& createRecordPeer,
         const rtsp::Session::SendRequest& sendRequest,
         const rtsp::Session::SendResponse& sendResponse) noexcept;
     ~Session();
@@ -34,6 +40,12 @@ public:
     const std::shared_ptr<spdlog::logger>& log() const
         { return _log; }
 
+    // peer created for subscriber is released with its media session
+    void startRecordToSubscriber(
+        const StreamerRoute&,
+        const std::string& uri,
+        const rtsp::MediaSessionId&) noexcept;
+
 protected:
     bool listEnabled(const std::string& uri) noexcept override;
     bool playEnabled(const std::string& uri) noexcept override;
@@ -51,6 +63,8 @@ protected:
         std::unique_ptr<rtsp::Request>&&) noexcept override;
     bool onSubscribeRequest(
         std::unique_ptr<rtsp::Request>&&) noexcept override;
+    bool onDescribeRequest(
+        std::unique_ptr<rtsp::Request>&&) noexcept override;
 
     bool handleResponse(
         const rtsp::Request&,
@@ -77,6 +91,30 @@ private:
 
     void startRecord(const std::string& uri, const rtsp::MediaSessionId& mediaSession) noexcept;
 
+    // single request asks for its route several times,
+    // so the last found one is kept until routes table is rebuilt
+    struct RouteCache {
+        uint64_t routesVersion = 0;
+        std::string streamerName;
+        const StreamerRoute* route = nullptr;
+    };
+
+    // "streamer" or "streamer/substream" -> route for "streamer"
+    const StreamerRoute* findRoute(std::string_view uri, std::string_view* substream = nullptr) noexcept;
+    // nullptr for uri with substream part
+    const StreamerRoute* findStreamerRoute(std::string_view uri) noexcept;
+
+    // rejects request if viewers limit is reached
+    bool admitViewer(const StreamerRoute&, const rtsp::Request&) noexcept;
+
+    // in flight requests and media sessions proxied through this agent session
+    size_t proxyLoad() const noexcept
+        { return _forwardedRequests.size() + _agentMediaSessions2clientMediaSession.size(); }
+
+    void updateAgentList(const std::string& uri, rtsp::Parameters&& list) noexcept;
+    void rebuildAgentsList(const std::string& uri) noexcept;
+    Session* selectAgent(const std::string& uri, const std::string& substream) noexcept;
+
     rtsp::MediaSessionId registerAgentMediaSession(
         std::shared_ptr<SessionHandle>& agentSession,
         const std::string& uri,
@@ -84,7 +122,7 @@ private:
 
     bool forwardRequest(
         std::shared_ptr<SessionHandle>& sourceSession,
-        const std::string& sourceUri,
+        std::string&& sourceUri,
         const std::string& sourceMediaSession,
         std::unique_ptr<rtsp::Request>& requestPtr) noexcept;
     bool forwardResponse(
@@ -103,8 +141,13 @@ private:
 
     std::shared_ptr<SessionHandle> _handle;
 
-    // reqest target side data
-    std::map<rtsp::CSeq, ForwardedRequest> _forwardedRequests;
+    PeerLeases _peerLeases;
+
+    RouteCache _routeCache;
+
+    // reqest target side data,
+    // entry is added and removed for every forwarded request, so no per entry allocations
+    FlatHashMap<rtsp::CSeq, ForwardedRequest> _forwardedRequests;
 
     // client side data
     std::map<rtsp::MediaSessionId, MediaSessionInfo> _clientMediaSession2agentMediaSession;
@@ -1,6 +1,19 @@
 #pragma once
 
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <queue>
 #include <unordered_map>
+#include <vector>
+
+#include "RtspParser/RtspParser.h"
+
+#include "ListCache.h"
+#include "MountPointState.h"
+#include "StreamerRoutes.h"
 
 
 struct SessionAuthTokenData {
@@ -8,18 +21,87 @@ struct SessionAuthTokenData {
     // FIXME! add allowed IP
 };
 
+struct AuthTokenExpiration {
+    std::chrono::steady_clock::time_point expiresAt;
+    std::string token;
+
+    bool operator > (const AuthTokenExpiration& other) const
+        { return expiresAt > other.expiresAt; }
+};
+
+struct AuthTokensStats {
+    uint64_t expired = 0;
+};
+
+struct LazyMountsStats {
+    uint64_t instantiated = 0;
+    uint64_t destroyed = 0;
+    std::chrono::microseconds lastInstantiationTime {};
+    std::chrono::microseconds maxInstantiationTime {};
+};
+
+struct MainLoopStats {
+    std::chrono::microseconds lastLatency {};
+    std::chrono::microseconds latencySum {};
+    uint64_t probes = 0;
+};
+
+class Session;
 struct RecordMountpointData {
     bool recording = false;
-    std::unordered_map<rtsp::ServerSession*, rtsp::MediaSessionId> subscriptions;
+    std::unordered_map<Session*, rtsp::MediaSessionId> subscriptions;
+};
+
+// held by session until media session of the peer it was given for is finished
+struct PeerLease {
+    std::string streamerName; // escaped
+    MountPointStatePtr mountPoint; // nullptr if peer doesn't use shared mount point
+};
+
+class GstStreamingSource; // #include "RtStreaming/GstRtStreaming/GstStreamingSource.h"
+// mount point created on first request and shared while it has peers
+struct OnDemandMountData {
+    std::shared_ptr<GstStreamingSource> streamer;
+    std::chrono::steady_clock::time_point startedAt;
+    MountPointStatePtr state = std::make_shared<MountPointState>();
+};
+
+// mount point removed on config reload, kept until its last peer is released
+struct RetiredMountData {
+    std::shared_ptr<GstStreamingSource> streamer;
+    MountPointStatePtr state;
+};
+
+// agent session serving Proxy mount point
+struct AgentMountpointData {
+    Session* agent;
+    std::map<std::string, std::string> list; // escaped item name -> description, as reported by agent
 };
 
-class Session;
 struct SessionsSharedData {
-    const std::string publicListCache;
-    const std::string protectedListCache;
-    const std::string agentListCache;
+    ListCachePtr publicListCache;
+    ListCachePtr protectedListCache;
+    ListCachePtr agentListCache;
     std::unordered_map<std::string, const SessionAuthTokenData> authTokens;
+    std::priority_queue<
+        AuthTokenExpiration,
+        std::vector<AuthTokenExpiration>,
+        std::greater<AuthTokenExpiration>> authTokensExpirations; // min-heap by expiresAt
+    AuthTokensStats authTokensStats;
     std::map<std::string, RecordMountpointData> recordMountpointsData;
-    std::map<std::string, std::string> mountpointsListsCache;
-    std::map<std::string, Session*> agentsMountpoints;
+    std::map<std::string, MountpointListCache> mountpointsListsCache;
+    std::map<std::string, std::vector<AgentMountpointData>> agentsMountpoints; // escaped streamer name -> agents
+    std::multimap<std::string, OnDemandMountData> filePlayerMounts; // canonicalized file path -> mount
+    std::map<std::string, OnDemandMountData, std::less<>> lazyMounts; // escaped streamer name -> mount
+    LazyMountsStats lazyMountsStats;
+    std::map<std::string, uint64_t, std::less<>> peersCreated; // escaped streamer name -> count
+    // peer is counted until its media session is finished
+    std::map<std::string, unsigned, std::less<>> streamersPeers; // escaped streamer name -> live peers
+    size_t peersCount = 0; // of all streamers together
+    uint64_t rejectedViewers = 0;
+    uint64_t forwardedRequestsInFlight = 0;
+    MainLoopStats mainLoopStats;
+    StreamerRoutes routes;
+    size_t sessionsCount = 0;
+    std::deque<RetiredMountData> retiredMounts;
 };
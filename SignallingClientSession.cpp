@@ -12,15 +12,29 @@
 
 SignallingClientSession::SignallingClientSession(
     const Config* config,
-    const SharedData* sharedData,
-    const CreatePeer& createPeer,
+    SharedData* sharedData,
+    const PeerLeases::CreatePeer& createPeer,
     const SendRequest& sendRequest,
     const SendResponse& sendResponse) noexcept :
-    ServerSession(config->webRTCConfig, createPeer, sendRequest, sendResponse),
+    ServerSession(
+        config->webRTCConfig,
+        std::bind(&PeerLeases::createPeer, &_peerLeases, createPeer, std::placeholders::_1),
+        sendRequest,
+        [this, sendResponse] (const rtsp::Response& response) {
+            _peerLeases.onResponse(response);
+            return sendResponse(response);
+        }),
     _config(config),
     _webRTCConfig(std::make_shared<WebRTCConfig>(*_config->webRTCConfig)),
-    _sharedData(sharedData)
+    _sharedData(sharedData),
+    _peerLeases(sharedData)
 {
+    ++_sharedData->sessionsCount;
+}
+
+SignallingClientSession::~SignallingClientSession()
+{
+    --_sharedData->sessionsCount;
 }
 
 bool SignallingClientSession::onConnected() noexcept
@@ -28,7 +42,7 @@ bool SignallingClientSession::onConnected() noexcept
     const SignallingServer& target = _config->signallingServer.value();
     sendList(
         target.uri,
-        _sharedData->agentListCache,
+        *_sharedData->agentListCache,
         target.token);
 
     return true;
@@ -88,8 +102,35 @@ bool SignallingClientSession::onGetParameterResponse(
 
     auto pendingRequests = std::move(_pendingRequests);
     for(auto& request: pendingRequests) {
-        ServerSession::onDescribeRequest(std::move(request));
+        const StreamerRoute* route = _sharedData->routes.findByUri(request->uri);
+        if(route && playEnabled(request->uri) && !admitViewer(*route, *request))
+            continue;
+
+        _peerLeases.describeStarted(request->cseq, route);
+        const bool handled = ServerSession::onDescribeRequest(std::move(request));
+        _peerLeases.describeFinished(handled);
     }
 
     return true;
 }
+
+bool SignallingClientSession::admitViewer(const StreamerRoute& route, const rtsp::Request& request) noexcept
+{
+    rtsp::StatusCode statusCode;
+    const char* reasonPhrase;
+    if(_peerLeases.admitViewer(*_config, route, &statusCode, &reasonPhrase))
+        return true;
+
+    rtsp::Response response;
+    prepareResponse(statusCode, reasonPhrase, request.cseq, std::string(), &response);
+    sendResponse(response);
+
+    return false;
+}
+
+void SignallingClientSession::teardownMediaSession(const rtsp::MediaSessionId& mediaSession) noexcept
+{
+    _peerLeases.release(mediaSession);
+
+    ServerSession::teardownMediaSession(mediaSession);
+}
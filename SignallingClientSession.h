@@ -4,6 +4,8 @@ class Config; // #include "Config.h"
 #include "RtspSession/ServerSession.h"
 class SessionsSharedData; // #include "SessionsSharedData.h"
 
+#include "PeerLeases.h"
+
 
 class SignallingClientSession : public rtsp::ServerSession
 {
@@ -12,10 +14,11 @@ public:
 
     SignallingClientSession(
         const Config*,
-        const SharedData*,
-        const CreatePeer& createPeer,
+        SharedData*,
+        const PeerLeases::CreatePeer& createPeer,
         const SendRequest& sendRequest,
         const SendResponse& sendResponse) noexcept;
+    ~SignallingClientSession();
 
     bool onConnected() noexcept override;
 
@@ -28,11 +31,19 @@ protected:
         const rtsp::Request&,
         const rtsp::Response&) noexcept override;
 
+    void teardownMediaSession(const rtsp::MediaSessionId&) noexcept override;
+
+private:
+    // rejects request if viewers limit is reached
+    bool admitViewer(const StreamerRoute&, const rtsp::Request&) noexcept;
+
 private:
     const Config *const _config;
     WebRTCConfigPtr _webRTCConfig;
-    const SharedData *const _sharedData;
+    SharedData *const _sharedData;
 
     std::optional<rtsp::CSeq> _iceServersRequest;
     std::deque<std::unique_ptr<rtsp::Request>> _pendingRequests;
+
+    PeerLeases _peerLeases;
 };
@@ -0,0 +1,91 @@
+#include "StreamerRoutes.h"
+
+#include "RtspParser/RtspParser.h"
+
+
+namespace {
+
+uint64_t LastRoutesVersion = 0; // main loop thread is the only user
+
+}
+
+bool IsLazyStreamer(const Config& config, const StreamerConfig& streamerConfig)
+{
+    if(!config.lazyMounts || !streamerConfig.restream)
+        return false;
+
+    switch(streamerConfig.type) {
+    case StreamerConfig::Type::Test:
+    case StreamerConfig::Type::ReStreamer:
+#if ONVIF_SUPPORT
+    case StreamerConfig::Type::ONVIFReStreamer:
+#endif
+    case StreamerConfig::Type::Pipeline:
+        return true;
+    default:
+        return false;
+    }
+}
+
+StreamerRoutes::StreamerRoutes(const Config& config) :
+    _version(++LastRoutesVersion)
+{
+    _routes.reserve(config.streamers.size());
+    for(const auto& [name, streamerConfig]: config.streamers) {
+        typedef StreamerConfig::Visibility Visibility;
+        const Visibility visibility = streamerConfig.visibility;
+        _routes.emplace(
+            name,
+            StreamerRoute {
+                name,
+                streamerConfig.type,
+                streamerConfig.restream,
+                visibility == Visibility::Protected ||
+                    (visibility == Visibility::Auto && config.authRequired),
+                IsLazyStreamer(config, streamerConfig),
+                &streamerConfig,
+                nullptr,
+                nullptr });
+    }
+}
+
+void StreamerRoutes::setMountPoint(
+    std::string_view streamerName,
+    GstStreamingSource* mountPoint,
+    const MountPointStatePtr& mountPointState)
+{
+    auto it = _routes.find(streamerName);
+    if(it != _routes.end()) {
+        it->second.mountPoint = mountPoint;
+        it->second.mountPointState = mountPointState;
+    }
+}
+
+const StreamerRoute* StreamerRoutes::find(std::string_view streamerName) const
+{
+    return _routes.lookup(streamerName);
+}
+
+std::string_view StreamerRoutes::SplitUri(
+    std::string_view uri,
+    std::string_view* substream)
+{
+    const std::string_view::size_type separatorPos = uri.find(rtsp::UriSeparator);
+    if(separatorPos == std::string_view::npos) {
+        if(substream)
+            *substream = std::string_view();
+        return uri;
+    }
+
+    if(substream)
+        *substream = uri.substr(separatorPos + 1);
+
+    return uri.substr(0, separatorPos);
+}
+
+const StreamerRoute* StreamerRoutes::findByUri(
+    std::string_view uri,
+    std::string_view* substream) const
+{
+    return find(SplitUri(uri, substream));
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "Config.h"
+#include "FlatHashMap.h"
+#include "MountPointState.h"
+
+
+class GstStreamingSource; // #include "RtStreaming/GstRtStreaming/GstStreamingSource.h"
+
+// everything required to route request to streamer, precomputed from Config
+struct StreamerRoute {
+    std::string_view name; // escaped
+    StreamerConfig::Type type;
+    bool restream;
+    bool authRequired; // Protected, or Auto with authentication required
+    bool lazy; // mount point is created on demand
+    const StreamerConfig* config;
+    GstStreamingSource* mountPoint; // nullptr if streamer doesn't have mount point
+    MountPointStatePtr mountPointState;
+};
+
+bool IsLazyStreamer(const Config&, const StreamerConfig&);
+
+class StreamerRoutes
+{
+public:
+    StreamerRoutes() = default;
+    explicit StreamerRoutes(const Config&);
+    // routes refer to Config they were built from
+    StreamerRoutes(const StreamerRoutes&) = delete;
+    StreamerRoutes(StreamerRoutes&&) = default;
+    StreamerRoutes& operator = (const StreamerRoutes&) = delete;
+    StreamerRoutes& operator = (StreamerRoutes&&) = default;
+
+    // "streamer" or "streamer/substream" -> "streamer",
+    // substream is set to default constructed view if uri doesn't have substream part
+    static std::string_view SplitUri(std::string_view uri, std::string_view* substream = nullptr);
+
+    // differs for every built table, so routes found in previous one can be detected
+    uint64_t version() const { return _version; }
+
+    void setMountPoint(std::string_view streamerName, GstStreamingSource*, const MountPointStatePtr&);
+
+    const StreamerRoute* find(std::string_view streamerName) const;
+
+    // "streamer" or "streamer/substream" -> route for "streamer"
+    const StreamerRoute* findByUri(
+        std::string_view uri,
+        std::string_view* substream = nullptr) const;
+
+private:
+    uint64_t _version = 0;
+    FlatHashMap<std::string_view, StreamerRoute> _routes; // escaped streamer name -> route
+};
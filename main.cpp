@@ -24,9 +24,9 @@
 
 #include "Client/Log.h"
 
+#include "CoturnService.h"
 #include "Log.h"
 #include "ReStreamer.h"
-#include "stun.h"
 
 
 static const auto Log = ReStreamerLog;
@@ -105,6 +105,16 @@ static bool LoadConfig(http::Config* httpConfig, Config* config, const gchar* ba
             loadedHttpConfig.port = static_cast<unsigned short>(httpPort);
         }
 
+        int metricsPort = 0;
+        if(CONFIG_TRUE == config_lookup_int(&config, "metrics-port", &metricsPort) && metricsPort > 0) {
+            loadedConfig.metricsPort = static_cast<unsigned short>(metricsPort);
+        }
+
+        int maxViewers = 0;
+        if(CONFIG_TRUE == config_lookup_int(&config, "max-viewers", &maxViewers) && maxViewers > 0) {
+            loadedConfig.maxViewers = maxViewers;
+        }
+
         const char* stunServer = nullptr;
         const char* turnServer = nullptr;
         config_setting_t* webrtcConfig = config_lookup(&config, "webrtc");
@@ -199,6 +209,15 @@ static bool LoadConfig(http::Config* httpConfig, Config* config, const gchar* ba
                             spdlog::level::critical - std::min<int>(lwsLogLevel, spdlog::level::critical));
                 }
             }
+            int mainLoopProfiler = FALSE;
+            if(CONFIG_TRUE == config_setting_lookup_bool(debugConfig, "main-loop-profiler", &mainLoopProfiler)) {
+                loadedConfig.mainLoopProfiler = mainLoopProfiler != FALSE;
+            }
+            int slowDispatchThreshold = 0;
+            if(CONFIG_TRUE == config_setting_lookup_int(debugConfig, "slow-dispatch-threshold", &slowDispatchThreshold)) {
+                if(slowDispatchThreshold > 0)
+                    loadedConfig.slowDispatchThreshold = std::chrono::milliseconds(slowDispatchThreshold);
+            }
         }
 
         config_setting_t* signallingServerConfig = config_lookup(&config, "signalling-server");
@@ -231,6 +250,16 @@ static bool LoadConfig(http::Config* httpConfig, Config* config, const gchar* ba
         }
 
 #if !BUILD_AS_CAMERA_STREAMER && !BUILD_AS_V4L2_RESTREAMER
+        int lazyMounts = FALSE;
+        if(CONFIG_TRUE == config_lookup_bool(&config, "lazy-mounts", &lazyMounts)) {
+            loadedConfig.lazyMounts = lazyMounts != FALSE;
+        }
+
+        int lazyMountsIdleTimeout = 0;
+        if(CONFIG_TRUE == config_lookup_int(&config, "lazy-mounts-idle-timeout", &lazyMountsIdleTimeout)) {
+            loadedConfig.lazyMountsIdleTimeout = std::chrono::seconds(std::max(lazyMountsIdleTimeout, 0));
+        }
+
         bool hasProxyStreamers = false;
         config_setting_t* streamersConfig = config_lookup(&config, "streamers");
         if(streamersConfig && CONFIG_TRUE == config_setting_is_list(streamersConfig)) {
@@ -251,6 +280,9 @@ static bool LoadConfig(http::Config* httpConfig, Config* config, const gchar* ba
                 int restream = TRUE;
                 config_setting_lookup_bool(streamerConfig, "restream", &restream);
 
+                int streamerMaxViewers = 0;
+                config_setting_lookup_int(streamerConfig, "max-viewers", &streamerMaxViewers);
+
                 const char* agentToken = "";
                 config_setting_lookup_string(streamerConfig, "record-token", &agentToken);
                 config_setting_lookup_string(streamerConfig, "agent-token", &agentToken);
@@ -287,6 +319,14 @@ static bool LoadConfig(http::Config* httpConfig, Config* config, const gchar* ba
                 const char* dir = nullptr;
                 config_setting_lookup_string(streamerConfig, "dir", &dir);
 
+                int listUpdateDelay = 1000;
+                config_setting_lookup_int(streamerConfig, "list-update-delay", &listUpdateDelay);
+                if(listUpdateDelay < 0) listUpdateDelay = 0;
+
+                int joinWindow = 0;
+                config_setting_lookup_int(streamerConfig, "join-window", &joinWindow);
+                if(joinWindow < 0) joinWindow = 0;
+
                 const char* pipeline = nullptr;
                 if(CONFIG_TRUE == config_setting_lookup_string(streamerConfig, "pipeline", &pipeline)) {
                    type = "pipeline";
@@ -374,7 +414,7 @@ static bool LoadConfig(http::Config* httpConfig, Config* config, const gchar* ba
                 }
 
                 g_autofree gchar* escapedName = g_uri_escape_string(name, nullptr, false);
-                loadedConfig.streamers.emplace(
+                auto [streamerIt, streamerInserted] = loadedConfig.streamers.emplace(
                     escapedName,
                     StreamerConfig {
                         streamerType,
@@ -396,6 +436,12 @@ static bool LoadConfig(http::Config* httpConfig, Config* config, const gchar* ba
                             std::string(forceH264ProfileLevelId) :
                             std::string(),
                         recordConfig });
+                if(streamerInserted) {
+                    streamerIt->second.filesListUpdateDelay = std::chrono::milliseconds(listUpdateDelay);
+                    streamerIt->second.filePlayerJoinWindow = std::chrono::seconds(joinWindow);
+                    if(streamerMaxViewers > 0)
+                        streamerIt->second.maxViewers = streamerMaxViewers;
+                }
             }
         }
 
@@ -562,160 +608,50 @@ static bool LoadConfig(http::Config* httpConfig, Config* config, const gchar* ba
     return success;
 }
 
-#if defined(SNAPCRAFT_BUILD) && !defined(BUILD_AS_CAMERA_STREAMER) && !defined(BUILD_AS_V4L2_RESTREAMER)
-static bool StopCoturn(bool disable)
+#if defined(SNAPCRAFT_BUILD) && defined(BUILD_AS_V4L2_RESTREAMER)
+static void SetDefaultEdidFilePath(std::map<std::string, StreamerConfig>* streamers)
 {
-    g_autoptr(GError) error = nullptr;
-    gint exitStatus = 0;
-
+    const gchar* snapPath = g_getenv("SNAP");
     const gchar* snapName = g_getenv("SNAP_NAME");
-    if(!snapName) {
-        Log()->error("Can't get SNAP_NAME environment variable");
-
-        return false;
-    }
+    if(!snapPath || !snapName || streamers->empty())
+        return;
 
-    g_autofree gchar* command =
-        disable ?
-            g_strdup_printf("snapctl stop %s.Coturn --disable", snapName) :
-            g_strdup_printf("snapctl stop %s.Coturn", snapName);
-    if(!g_spawn_command_line_sync(
-        command,
-        nullptr,
-        nullptr,
-        &exitStatus,
-        &error) ||
-        !g_spawn_check_wait_status(exitStatus, &error))
+    StreamerConfig& streamerConfig = streamers->begin()->second;
+    if(streamerConfig.type == StreamerConfig::Type::V4L2 &&
+        !streamerConfig.edidFilePath.has_value())
     {
-        Log()->error(
-            fmt::runtime(
-                disable ?
-                    "Failed to disable Coturn: {}" :
-                    "Failed to stop Coturn: {}"),
-            error->message);
-
-        return false;
+        GCharPtr edidFilePathPtr(
+            g_build_path(
+                G_DIR_SEPARATOR_S,
+                snapPath,
+                "opt",
+                snapName,
+                "share",
+                "default.edid",
+                NULL));
+        streamerConfig.edidFilePath = std::string(edidFilePathPtr.get());
     }
-
-    Log()->info(
-        disable ?
-            "Coturn disabled" :
-            "Coturn stopped");
-
-    return true;
 }
+#endif
 
-static void ConfigureCoturn(Config* config)
+#if defined(SNAPCRAFT_BUILD) && !defined(BUILD_AS_CAMERA_STREAMER) && !defined(BUILD_AS_V4L2_RESTREAMER)
+static std::unique_ptr<CoturnService> CreateCoturnService()
 {
-    assert(config->useServerMode() && config->agentsConfig.useCoturn);
-
     const gchar* snapName = g_getenv("SNAP_NAME");
     if(!snapName) {
         Log()->error("Can't get SNAP_NAME environment variable");
 
-        return;
+        return nullptr;
     }
 
     const gchar* snapCommon = g_getenv("SNAP_COMMON");
     if(!snapCommon) {
         Log()->error("Can't get SNAP_COMMON environment variable");
 
-        return;
-    }
-
-    g_autoptr(GError) error = nullptr;
-    gint exitStatus = 0;
-
-    g_autofree gchar* setPublicIPCommand = nullptr;
-    if(config->publicIp.has_value())
-        setPublicIPCommand = g_strdup_printf("snapctl set public-ip=%s", config->publicIp->c_str());
-    const gchar* unsetPublicIPCommand = "snapctl unset public-ip";
-    if(!g_spawn_command_line_sync(
-        setPublicIPCommand ? setPublicIPCommand : unsetPublicIPCommand,
-        nullptr,
-        nullptr,
-        &exitStatus,
-        &error) ||
-        !g_spawn_check_wait_status(exitStatus, &error))
-    {
-        Log()->error("Failed to set \"public-ip\": {}", error->message);
-
-        return;
+        return nullptr;
     }
 
-    g_autofree gchar* pwgenStdout = nullptr;
-    if(!g_spawn_command_line_sync(
-        "pwgen --secure --capitalize 127",
-        &pwgenStdout,
-        nullptr,
-        &exitStatus,
-        &error) ||
-        !g_spawn_check_wait_status(exitStatus, &error))
-    {
-        Log()->error("Failed to generate TURN REST API secret", error->message);
-
-        return;
-    }
-
-    std::string staticAuthSecret = pwgenStdout;
-    if(staticAuthSecret.back() == '\n')
-        staticAuthSecret.pop_back();
-
-    g_autofree gchar* deleteSecretsCmd = g_strdup_printf(
-        "turnadmin --db=%s/turndb --delete-all-secret --realm=%s",
-        snapCommon,
-        snapName);
-
-    if(!g_spawn_command_line_sync(
-        deleteSecretsCmd,
-        nullptr,
-        nullptr,
-        &exitStatus,
-        &error) ||
-        !g_spawn_check_wait_status(exitStatus, &error))
-    {
-        Log()->error("Failed to delete old TURN REST API secrets: {}", error->message);
-
-        return;
-    }
-
-    g_autofree gchar* setSecretCmd = g_strdup_printf(
-        "turnadmin --db=%s/turndb --set-secret=%s --realm=%s",
-        snapCommon,
-        staticAuthSecret.c_str(),
-        snapName);
-
-    if(!g_spawn_command_line_sync(
-        setSecretCmd,
-        nullptr,
-        nullptr,
-        &exitStatus,
-        &error) ||
-        !g_spawn_check_wait_status(exitStatus, &error))
-    {
-        Log()->error("Failed to set TURN REST API secret: {}", error->message);
-
-        return;
-    }
-
-    g_autofree gchar* startCommand =
-        g_strdup_printf("snapctl start %s.Coturn", snapName);
-    if(!g_spawn_command_line_sync(
-        startCommand,
-        nullptr,
-        nullptr,
-        &exitStatus,
-        &error) ||
-        !g_spawn_check_wait_status(exitStatus, &error))
-    {
-        Log()->error("Failed to enable Coturn: {}", error->message);
-
-        return;
-    }
-
-    Log()->info("Coturn configured and started");
-
-    config->coturnConfig.staticAuthSecret.emplace(std::move(staticAuthSecret));
+    return std::make_unique<CoturnService>(snapName, snapCommon);
 }
 #endif
 
@@ -737,54 +673,15 @@ int main(int argc, char *argv[])
     basePath = g_getenv("SNAP_COMMON");
 #endif
 
+    const auto configLoadStartedAt = std::chrono::steady_clock::now();
     Config config {};
     config.bindToLoopbackOnly = false;
     if(!LoadConfig(&httpConfig, &config, basePath))
         return -1;
+    LogStartupPhase("Config loading", configLoadStartedAt);
 
 #if defined(SNAPCRAFT_BUILD) && defined(BUILD_AS_V4L2_RESTREAMER)
-    if(snapPath && snapName && !config.streamers.empty()) {
-        StreamerConfig& streamerConfig = config.streamers.begin()->second;
-        if(streamerConfig.type == StreamerConfig::Type::V4L2 &&
-            !streamerConfig.edidFilePath.has_value())
-        {
-            GCharPtr edidFilePathPtr(
-                g_build_path(
-                    G_DIR_SEPARATOR_S,
-                    snapPath,
-                    "opt",
-                    snapName,
-                    "share",
-                    "default.edid",
-                    NULL));
-            streamerConfig.edidFilePath = std::string(edidFilePathPtr.get());
-        }
-    }
-#endif
-
-#if defined(SNAPCRAFT_BUILD) && !defined(BUILD_AS_CAMERA_STREAMER) && !defined(BUILD_AS_V4L2_RESTREAMER)
-    const bool disableCoturn = config.useAgentMode() || !config.agentsConfig.useCoturn;
-    // to workaround "error running snapctl: snap "rtsp-to-webrtsp" has "install-snap" change in progress"
-    // have to try multiple times
-    for(guint i = 0; i <= 3; ++i) {
-        if(i != 0) {
-            const int delay = i;
-            Log()->info("Sleeping for {} seconds before try to disable Coturn another time...", delay);
-            sleep(delay);
-        }
-        if(StopCoturn(disableCoturn))
-            break;
-    }
-#endif
-
-#if !defined(BUILD_AS_CAMERA_STREAMER) && !defined(BUILD_AS_V4L2_RESTREAMER)
-    if(config.useServerMode() && config.agentsConfig.useCoturn)
-        config.publicIp = DetectPublicIP(*config.webRTCConfig);
-#endif
-
-#if defined(SNAPCRAFT_BUILD) && !defined(BUILD_AS_CAMERA_STREAMER) && !defined(BUILD_AS_V4L2_RESTREAMER)
-    if(!disableCoturn)
-        ConfigureCoturn(&config);
+    SetDefaultEdidFilePath(&config.streamers);
 #endif
 
 #ifdef SNAPCRAFT_BUILD
@@ -806,5 +703,50 @@ int main(int argc, char *argv[])
 
     LibGst libGst;
 
-    return ReStreamerMain(httpConfig, config, true);
+    // only streamers are reloaded, everything else requires restart
+    auto loadStreamersConfig =
+        [basePath] (std::map<std::string, StreamerConfig>* streamers) -> bool {
+            http::Config reloadedHttpConfig {};
+            Config reloadedConfig {};
+            reloadedConfig.bindToLoopbackOnly = false;
+            if(!LoadConfig(&reloadedHttpConfig, &reloadedConfig, basePath))
+                return false;
+
+#if defined(SNAPCRAFT_BUILD) && defined(BUILD_AS_V4L2_RESTREAMER)
+            SetDefaultEdidFilePath(&reloadedConfig.streamers);
+#endif
+
+            *streamers = std::move(reloadedConfig.streamers);
+
+            return true;
+        };
+
+    // Coturn is provisioned while signalling server is serving already
+    StartBackgroundTasks startBackgroundTasks;
+    PublicIPChanged publicIPChanged;
+#if defined(SNAPCRAFT_BUILD) && !defined(BUILD_AS_CAMERA_STREAMER) && !defined(BUILD_AS_V4L2_RESTREAMER)
+    std::unique_ptr<CoturnService> coturnServicePtr = CreateCoturnService();
+    if(CoturnService* coturnService = coturnServicePtr.get()) {
+        if(config.useAgentMode() || !config.agentsConfig.useCoturn) {
+            startBackgroundTasks = std::bind(&CoturnService::disable, coturnService);
+        } else {
+            startBackgroundTasks =
+                [coturnService] (Config* runningConfig) {
+                    coturnService->start(
+                        [runningConfig] (const std::string& staticAuthSecret) {
+                            runningConfig->coturnConfig.staticAuthSecret = staticAuthSecret;
+                        });
+                };
+            publicIPChanged = std::bind(&CoturnService::setPublicIP, coturnService, std::placeholders::_1);
+        }
+    }
+#endif
+
+    return ReStreamerMain(
+        httpConfig,
+        config,
+        true,
+        loadStreamersConfig,
+        publicIPChanged,
+        startBackgroundTasks);
 }
@@ -1,13 +1,13 @@
 #include "stun.h"
 
+#include <algorithm>
+#include <cassert>
 #include <string>
 
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
 
-#include <gio/gio.h>
-
 #include <stun/usages/bind.h>
 
 #include "RtStreaming/GstRtStreaming/Helpers.h"
@@ -20,34 +20,26 @@
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(addrinfo, freeaddrinfo)
 
 
-std::optional<std::string> DetectPublicIP(const WebRTCConfig& webRTCConfig)
-{
-    const auto& log = ReStreamerLog();
+namespace {
 
-    std::optional<std::string> stunUrl;
+const auto Log = ReStreamerLog;
 
-    using GstRtStreaming::IceServerType;
-    using GstRtStreaming::ParseIceServerType;
-    for(const std::string& iceServer: webRTCConfig.iceServers) {
-        if(IceServerType::Stun ==  ParseIceServerType(iceServer)) {
-            stunUrl = iceServer;
-            break;
-        }
-    }
+const char DefaultStunUrl[] = "stun://stun.l.google.com:19302";
 
-    if(!stunUrl) {
-        stunUrl = "stun://stun.l.google.com:19302";
-        log->info("There is no STUN server provided in config. Using hardcoded one to detect public IP: {}", *stunUrl);
-    }
+enum {
+    MAX_RETRY_DELAY = 256, // seconds
+};
 
+// blocking, so runs on GTask worker thread
+std::optional<std::string> QueryPublicIP(const std::string& stunUrl)
+{
     g_autoptr(GError) error = nullptr;
-    g_autoptr(GUri) uri = g_uri_parse(stunUrl->c_str(), G_URI_FLAGS_HAS_PASSWORD, &error);
+    g_autoptr(GUri) uri = g_uri_parse(stunUrl.c_str(), G_URI_FLAGS_HAS_PASSWORD, &error);
     if(!uri) {
-        log->error("Failed to parse STUN server URL \"{}\": {}", *stunUrl, error->message);
+        Log()->error("Failed to parse STUN server URL \"{}\": {}", stunUrl, error->message);
         return {};
     }
 
-    const gchar* scheme = g_uri_get_scheme(uri);
     const gchar* host = g_uri_get_host(uri);
     gint port = g_uri_get_port(uri);
 
@@ -56,50 +48,197 @@ std::optional<std::string> DetectPublicIP(const WebRTCConfig& webRTCConfig)
         .ai_socktype = SOCK_DGRAM
     };
 
-    for(guint i = 0; i < 5; ++i) {
-        if(i != 0) {
-            const guint baseDelay = 1 << std::min(i, 8u);
-            const int delay = g_random_int_range(baseDelay,  baseDelay << 1);
-            log->info("Sleeping for {} seconds before try to get public IP another time...", delay);
-            sleep(delay);
-        }
+    g_autofree gchar* service = (port != -1) ? g_strdup_printf("%i", port) : nullptr;
+    g_autoptr(addrinfo) addrinfos = nullptr;
+    if(int ret = getaddrinfo(host, service ? service : DEFAULT_STUN_SERVICE, &hints, &addrinfos)) {
+        Log()->error("Failed to resolve \"{}\": {}", host, gai_strerror(ret));
+        return {};
+    }
 
-        g_autofree gchar* service = (port != -1) ? g_strdup_printf("%i", port) : nullptr;
-        g_autoptr(addrinfo) addrinfos = nullptr;
-        if(int ret = getaddrinfo(host, service ? service : DEFAULT_STUN_SERVICE, &hints, &addrinfos)) {
-            log->error("Failed to resolve \"{}\": {}", host, gai_strerror(ret));
-            continue;
-        }
+    addrinfo* ai = addrinfos;
+    sockaddr_storage publicAddressStorage;
+    socklen_t publicAddressStorageLen = sizeof(publicAddressStorage);
+
+    const StunUsageBindReturn bindRet = stun_usage_bind_run_compat(
+        ai->ai_addr,
+        ai->ai_addrlen,
+        &publicAddressStorage,
+        &publicAddressStorageLen,
+        STUN_COMPATIBILITY_RFC5389);
+    if(bindRet != STUN_USAGE_BIND_RETURN_SUCCESS) {
+        Log()->error("Failed to do STUN bind requst to \"{}\"", stunUrl);
+        return {};
+    }
+    assert(publicAddressStorage.ss_family == AF_INET);
 
-        addrinfo* ai = addrinfos;
-        sockaddr_storage publicAddressStorage;
-        socklen_t publicAddressStorageLen = sizeof(publicAddressStorage);
-
-        const StunUsageBindReturn bindRet = stun_usage_bind_run_compat(
-            ai->ai_addr,
-            ai->ai_addrlen,
-            &publicAddressStorage,
-            &publicAddressStorageLen,
-            STUN_COMPATIBILITY_RFC5389);
-        if(bindRet != STUN_USAGE_BIND_RETURN_SUCCESS) {
-            log->error("Failed to do STUN bind requst");
-            continue;
-        }
-        assert(publicAddressStorage.ss_family == AF_INET);
+    const sockaddr_in& publicAddress = *reinterpret_cast<sockaddr_in*>(&publicAddressStorage);
 
-        const sockaddr_in& publicAddress = *reinterpret_cast<sockaddr_in*>(&publicAddressStorage);
+    char publicIp[INET6_ADDRSTRLEN];
+    if(!inet_ntop(publicAddress.sin_family, &publicAddress.sin_addr, publicIp, sizeof(publicIp))) {
+        Log()->error("Failed to stringize IP address");
+        return {};
+    }
 
-        char publicIp[INET6_ADDRSTRLEN];
-        if(!inet_ntop(publicAddress.sin_family, &publicAddress.sin_addr, publicIp, sizeof(publicIp))) {
-            log->error("Failed to stringize IP address");
-            continue;
-        }
+    return publicIp;
+}
+
+}
+
+// owned by task, so it's freed even if task callback is never dispatched
+struct PublicIPDetector::QueryData {
+    std::string stunUrl;
+    uint64_t round;
+};
+
+PublicIPDetector::PublicIPDetector(
+    const WebRTCConfig& webRTCConfig,
+    std::chrono::seconds recheckInterval,
+    const PublicIPChanged& publicIPChanged) noexcept :
+    _recheckInterval(recheckInterval),
+    _publicIPChanged(publicIPChanged),
+    _cancellablePtr(g_cancellable_new())
+{
+    using GstRtStreaming::IceServerType;
+    using GstRtStreaming::ParseIceServerType;
+    for(const std::string& iceServer: webRTCConfig.iceServers) {
+        if(IceServerType::Stun == ParseIceServerType(iceServer))
+            _stunUrls.push_back(iceServer);
+    }
 
-        log->info("Detected public IP: {}", publicIp);
+    if(_stunUrls.empty()) {
+        _stunUrls.push_back(DefaultStunUrl);
+        Log()->info(
+            "There is no STUN server provided in config. Using hardcoded one to detect public IP: {}",
+            DefaultStunUrl);
+    }
+}
+
+PublicIPDetector::~PublicIPDetector()
+{
+    // pending tasks keep own reference to cancellable,
+    // so their callbacks can check it after detector is destroyed
+    g_cancellable_cancel(_cancellablePtr.get());
+
+    if(_detectSourcePtr)
+        g_source_destroy(_detectSourcePtr.get());
+}
+
+void PublicIPDetector::start() noexcept
+{
+    _startedAt = std::chrono::steady_clock::now();
+
+    detect();
+}
 
-        return publicIp;
+void PublicIPDetector::scheduleDetect(std::chrono::seconds delay) noexcept
+{
+    assert(!_detectSourcePtr);
+
+    _detectSourcePtr.reset(g_timeout_source_new_seconds(delay.count()));
+    GSource* timeoutSource = _detectSourcePtr.get();
+    g_source_set_callback(
+        timeoutSource,
+        [] (gpointer userData) -> gboolean {
+            PublicIPDetector* detector = static_cast<PublicIPDetector*>(userData);
+            detector->_detectSourcePtr.reset();
+            detector->detect();
+            return false;
+        },
+        this,
+        nullptr);
+    GMainContext* threadContext = g_main_context_get_thread_default();
+    g_source_attach(timeoutSource, threadContext ? threadContext : g_main_context_default());
+}
+
+void PublicIPDetector::detect() noexcept
+{
+    ++_round;
+    _roundSucceeded = false;
+    _pendingQueries = _stunUrls.size();
+
+    for(const std::string& stunUrl: _stunUrls) {
+        GTask* task = g_task_new(nullptr, _cancellablePtr.get(), onQueryReady, this);
+        g_task_set_task_data(
+            task,
+            new QueryData { stunUrl, _round },
+            [] (gpointer taskData) { delete static_cast<QueryData*>(taskData); });
+        g_task_run_in_thread(
+            task,
+            [] (GTask* task, gpointer, gpointer taskData, GCancellable*) {
+                if(g_task_return_error_if_cancelled(task))
+                    return;
+
+                const std::optional<std::string> publicIp =
+                    QueryPublicIP(static_cast<const QueryData*>(taskData)->stunUrl.c_str());
+                if(publicIp) {
+                    g_task_return_pointer(task, g_strdup(publicIp->c_str()), g_free);
+                } else {
+                    g_task_return_new_error(
+                        task,
+                        G_IO_ERROR,
+                        G_IO_ERROR_FAILED,
+                        "Failed to detect public IP");
+                }
+            });
+        g_object_unref(task);
     }
+}
+
+void PublicIPDetector::onQueryReady(GObject*, GAsyncResult* result, gpointer userData)
+{
+    GTask* task = G_TASK(result);
+
+    // result has to be freed in any case
+    g_autoptr(GError) error = nullptr;
+    g_autofree gchar* publicIp = static_cast<gchar*>(g_task_propagate_pointer(task, &error));
+
+    if(g_cancellable_is_cancelled(g_task_get_cancellable(task)))
+        return; // detector is destroyed already
+
+    const QueryData* queryData = static_cast<const QueryData*>(g_task_get_task_data(task));
+    static_cast<PublicIPDetector*>(userData)->onQueryFinished(
+        queryData->round,
+        publicIp ? std::optional<std::string>(publicIp) : std::nullopt);
+}
+
+void PublicIPDetector::onQueryFinished(uint64_t round, const std::optional<std::string>& publicIp) noexcept
+{
+    if(round != _round)
+        return;
+
+    assert(_pendingQueries > 0);
+    --_pendingQueries;
+
+    if(_roundSucceeded)
+        return;
+
+    if(publicIp) {
+        _roundSucceeded = true;
+        _failedRounds = 0;
+
+        if(publicIp != _publicIp) {
+            if(_publicIp)
+                Log()->info("Public IP changed: {} -> {}", *_publicIp, *publicIp);
+            else {
+                Log()->info("Detected public IP: {}", *publicIp);
+                LogStartupPhase("Public IP detection", _startedAt);
+            }
+
+            _publicIp = publicIp;
+            if(_publicIPChanged)
+                _publicIPChanged(*_publicIp);
+        }
 
-    log->warn("Failed to detect public IP");
-    return {};
+        scheduleDetect(_recheckInterval);
+    } else if(_pendingQueries == 0) {
+        ++_failedRounds;
+
+        // previously detected IP is kept
+        const unsigned baseDelay = std::min(1u << std::min(_failedRounds, 8u), unsigned(MAX_RETRY_DELAY));
+        const std::chrono::seconds delay(
+            std::min<gint64>(g_random_int_range(baseDelay, baseDelay << 1), _recheckInterval.count()));
+        Log()->warn("Failed to detect public IP. Next try in {} seconds", delay.count());
+
+        scheduleDetect(delay);
+    }
 }
@@ -1,6 +1,64 @@
 #pragma once
 
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <gio/gio.h>
+
+#include <CxxPtr/GlibPtr.h>
+
 #include "Config.h"
 
 
-std::optional<std::string> DetectPublicIP(const WebRTCConfig&);
+// queries all STUN servers from config in parallel, first answer wins,
+// and repeats it periodically to follow public IP changes
+class PublicIPDetector
+{
+public:
+    typedef std::function<void (const std::string& publicIp)> PublicIPChanged;
+
+    PublicIPDetector(
+        const WebRTCConfig&,
+        std::chrono::seconds recheckInterval,
+        const PublicIPChanged&) noexcept;
+    ~PublicIPDetector();
+
+    // detection is done on thread default main context
+    void start() noexcept;
+
+    const std::optional<std::string>& publicIp() const noexcept
+        { return _publicIp; }
+
+private:
+    struct QueryData;
+
+    void detect() noexcept;
+    void scheduleDetect(std::chrono::seconds delay) noexcept;
+    void onQueryFinished(uint64_t round, const std::optional<std::string>& publicIp) noexcept;
+
+    static void onQueryReady(GObject*, GAsyncResult*, gpointer userData);
+
+private:
+    struct ObjectUnref {
+        void operator() (gpointer object) { g_object_unref(object); }
+    };
+
+    std::vector<std::string> _stunUrls;
+    const std::chrono::seconds _recheckInterval;
+    const PublicIPChanged _publicIPChanged;
+
+    std::unique_ptr<GCancellable, ObjectUnref> _cancellablePtr;
+    GSourcePtr _detectSourcePtr;
+
+    uint64_t _round = 0;
+    bool _roundSucceeded = false;
+    unsigned _pendingQueries = 0;
+    unsigned _failedRounds = 0;
+    std::chrono::steady_clock::time_point _startedAt;
+
+    std::optional<std::string> _publicIp;
+};